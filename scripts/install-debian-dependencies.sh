@@ -4,6 +4,7 @@ printf "%b\n" "info: installing build dependencies for jgmenu..."
 
 sudo apt-get install \
 	libx11-dev \
+	libxext-dev \
 	libxrandr-dev \
 	libcairo2-dev \
 	libpango1.0-dev \
@@ -6,6 +6,7 @@
 #include "args.h"
 #include "config.h"
 #include "util.h"
+#include "prof.h"
 #include "banned.h"
 
 static char *checkout;
@@ -13,6 +14,7 @@ static char *csv_file;
 static char *csv_cmd;
 static int simple;
 static int die_when_loaded;
+static char *offscreen;
 
 void args_exec_commands(int argc, char **argv)
 {
@@ -47,6 +49,12 @@ void args_parse(int argc, char **argv)
 			csv_file = argv[i] + 11;
 		} else if (!strncmp(argv[i], "--csv-cmd=", 10)) {
 			csv_cmd = argv[i] + 10;
+		} else if (!strncmp(argv[i], "--offscreen=", 12)) {
+			offscreen = argv[i] + 12;
+		} else if (!strncmp(argv[i], "--profile=", 10)) {
+			prof_enable(argv[i] + 10);
+		} else if (!strcmp(argv[i], "--profile")) {
+			prof_enable(NULL);
 		} else if (!strncmp(argv[i], "--center", 8)) {
 			config.menu_halign = CENTER;
 			config.menu_valign = CENTER;
@@ -79,3 +87,8 @@ int args_die_when_loaded(void)
 {
 	return die_when_loaded;
 }
+
+char *args_offscreen(void)
+{
+	return offscreen;
+}
@@ -8,5 +8,6 @@ char *args_csv_file(void);
 char *args_csv_cmd(void);
 int args_simple(void);
 int args_die_when_loaded(void);
+char *args_offscreen(void);
 
 #endif /* ARGS_H */
@@ -7,6 +7,7 @@
 #include <unistd.h>
 
 #include "cache.h"
+#include "spawn.h"
 #include "util.h"
 #include "banned.h"
 
@@ -112,18 +113,13 @@ static int cache_check_index_theme(const char *theme, int size)
 
 static void cache_delete(void)
 {
-	char cmd[512];
-	int ret;
+	const char *cmd[] = { "rm", "-rf", NULL, NULL };
 
 	if (!cache_location || !cache_location->len)
 		die("must do cache_init() before cache_delete()!");
-	if (cache_location->len > 500)
-		die("path to icon path is too long");
-	snprintf(cmd, sizeof(cmd), "rm -rf %s", cache_location->buf);
-	cmd[511] = '\0';
-	ret = system(cmd);
-	if (ret)
-		warn("deleting cache returned %d (cmd='%s')", ret, cmd);
+	/* rather than system(), so that signals are unblocked in the child */
+	cmd[2] = cache_location->buf;
+	spawn_sync(cmd);
 }
 
 static void cache_init(void)
@@ -217,6 +213,14 @@ int cache_strdup_path(const char *name, struct sbuf *path)
 	return ret;
 }
 
+void cache_path(const char *name, struct sbuf *path)
+{
+	cache_init();
+	sbuf_cpy(path, cache_location->buf);
+	sbuf_addch(path, '/');
+	sbuf_addstr(path, name);
+}
+
 int cache_create_symlink(char *path, char *name)
 {
 	struct sbuf target, linkpath;
@@ -8,6 +8,9 @@ void cache_set_icon_size(int size);
 int cache_touch(const char *name);
 int cache_strdup_path(const char *name, struct sbuf *path);
 int cache_create_symlink(char *path, char *name);
+
+/* cache_path - set @path to file @name in the cache directory */
+void cache_path(const char *name, struct sbuf *path);
 void cache_atexit_cleanup(void);
 
 #endif /* CACHE_H */
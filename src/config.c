@@ -33,6 +33,9 @@ void config_set_defaults(void)
 	config.hide_back_items	   = 1;
 	config.columns		   = 1;
 	config.tabs		   = 120;
+	config.filter_parallel_threshold = 5000;
+	config.mit_shm		   = 0;
+	config.threaded_rendering  = 0;
 
 	config.menu_margin_x	   = 0;
 	config.menu_margin_y	   = 0;
@@ -74,6 +77,7 @@ void config_set_defaults(void)
 	config.icon_text_spacing   = 10;
 	config.icon_theme	   = NULL; /* Leave as NULL (see theme.c) */
 	config.icon_theme_fallback = xstrdup("xtg");
+	config.icon_memory_max	   = 16384;
 
 	config.arrow_string	   = xstrdup("▸");
 	config.arrow_width	   = 15;
@@ -173,6 +177,12 @@ static void process_line(char *line)
 		xatoi(&config.columns, value, XATOI_GT_0, "config.columns");
 	} else if (!strcmp(option, "tabs")) {
 		xatoi(&config.tabs, value, XATOI_NONNEG, "config.tabs");
+	} else if (!strcmp(option, "filter_parallel_threshold")) {
+		xatoi(&config.filter_parallel_threshold, value, XATOI_NONNEG, "config.filter_parallel_threshold");
+	} else if (!strcmp(option, "mit_shm")) {
+		xatoi(&config.mit_shm, value, XATOI_NONNEG, "config.mit_shm");
+	} else if (!strcmp(option, "threaded_rendering")) {
+		xatoi(&config.threaded_rendering, value, XATOI_NONNEG, "config.threaded_rendering");
 
 	} else if (!strcmp(option, "menu_margin_x")) {
 		xatoi(&config.menu_margin_x, value, XATOI_NONNEG, "config.margin_x");
@@ -305,6 +315,8 @@ static void process_line(char *line)
 	} else if (!strcmp(option, "icon_theme_fallback")) {
 		xfree(config.icon_theme_fallback);
 		config.icon_theme_fallback = xstrdup(value);
+	} else if (!strcmp(option, "icon_memory_max")) {
+		xatoi(&config.icon_memory_max, value, XATOI_NONNEG, "config.icon_memory_max");
 
 	} else if (!strcmp(option, "arrow_string")) {
 		xfree(config.arrow_string);
@@ -425,36 +437,13 @@ static int smallest_of_four(int a, int b, int c, int d)
 	return a;
 }
 
-void config_post_process(void)
+/*
+ * Resolve csv_cmd keywords and set the environment variables read by csv
+ * generators. This has to be run before the generator is started, which is
+ * earlier than config_post_process().
+ */
+void config_csv_post_process(void)
 {
-	int smallest_padding;
-
-	/*
-	 * The menu-border is drawn 'inside' the menu. Therefore, padding_* has
-	 * to allow for the border thickness.
-	 */
-	set_floor(&config.menu_padding_bottom, config.menu_border);
-	set_floor(&config.menu_padding_left, config.menu_border);
-	set_floor(&config.menu_padding_right, config.menu_border);
-	set_floor(&config.menu_padding_top, config.menu_border);
-
-	smallest_padding = smallest_of_four(config.menu_padding_top,
-					    config.menu_padding_left,
-					    config.menu_padding_bottom,
-					    config.menu_padding_right);
-	/*
-	 * Use '< 0' to include both CONFIG_AUTO and -1 (for backward
-	 * compatibility)
-	 */
-	if (config.sub_padding_top < 0)
-		config.sub_padding_top = smallest_padding;
-	if (config.sub_padding_right < 0)
-		config.sub_padding_right = smallest_padding;
-	if (config.sub_padding_bottom < 0)
-		config.sub_padding_bottom  = smallest_padding;
-	if (config.sub_padding_left < 0)
-		config.sub_padding_left = smallest_padding;
-
 	/* Resolve csv_cmd keywords */
 	if (!strcmp(config.csv_cmd, "pmenu")) {
 		xfree(config.csv_cmd);
@@ -470,10 +459,6 @@ void config_post_process(void)
 		config.csv_cmd = xstrdup("jgmenu_run ob");
 	}
 
-	if (config.menu_height_max &&
-	    config.menu_height_min > config.menu_height_max)
-		warn("menu_height_min cannot be greater than menu_height_max");
-
 	if (config.verbosity) {
 		char buf[8];
 
@@ -494,3 +479,40 @@ void config_post_process(void)
 	if (config.csv_i18n)
 		setenv("JGMENU_I18N", config.csv_i18n, 1);
 }
+
+void config_post_process(void)
+{
+	int smallest_padding;
+
+	/*
+	 * The menu-border is drawn 'inside' the menu. Therefore, padding_* has
+	 * to allow for the border thickness.
+	 */
+	set_floor(&config.menu_padding_bottom, config.menu_border);
+	set_floor(&config.menu_padding_left, config.menu_border);
+	set_floor(&config.menu_padding_right, config.menu_border);
+	set_floor(&config.menu_padding_top, config.menu_border);
+
+	smallest_padding = smallest_of_four(config.menu_padding_top,
+					    config.menu_padding_left,
+					    config.menu_padding_bottom,
+					    config.menu_padding_right);
+	/*
+	 * Use '< 0' to include both CONFIG_AUTO and -1 (for backward
+	 * compatibility)
+	 */
+	if (config.sub_padding_top < 0)
+		config.sub_padding_top = smallest_padding;
+	if (config.sub_padding_right < 0)
+		config.sub_padding_right = smallest_padding;
+	if (config.sub_padding_bottom < 0)
+		config.sub_padding_bottom  = smallest_padding;
+	if (config.sub_padding_left < 0)
+		config.sub_padding_left = smallest_padding;
+
+	if (config.menu_height_max &&
+	    config.menu_height_min > config.menu_height_max)
+		warn("menu_height_min cannot be greater than menu_height_max");
+
+	config_csv_post_process();
+}
@@ -27,6 +27,9 @@ struct config {
 	int hide_back_items;
 	int columns;
 	int tabs;
+	int filter_parallel_threshold;
+	int mit_shm;
+	int threaded_rendering;
 
 	int menu_margin_x;
 	int menu_margin_y;
@@ -67,6 +70,7 @@ struct config {
 	int icon_text_spacing;
 	char *icon_theme;
 	char *icon_theme_fallback;
+	int icon_memory_max;	/* kB; 0 means no limit */
 
 	char *arrow_string;
 	int arrow_width;
@@ -95,6 +99,7 @@ extern struct config config;
 void config_set_defaults(void);
 void config_cleanup(void);
 void config_read_jgmenurc(const char *filename);
+void config_csv_post_process(void);
 void config_post_process(void);
 
 #endif /* CONFIG_H */
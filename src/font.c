@@ -1,5 +1,8 @@
 /* font.c - a helper to find 'the' font */
 
+#include <pthread.h>
+#include <pango/pangocairo.h>
+
 #include "font.h"
 #include "xsettings-helper.h"
 #include "t2conf.h"
@@ -11,6 +14,8 @@
 
 static struct sbuf font;
 static int font_has_been_set;
+static pthread_t warmup_thread;
+static int warmup_running;
 
 char *font_get(void)
 {
@@ -71,7 +76,53 @@ void font_set(void)
 	sbuf_cpy(&font, "Sans 10");
 }
 
+/*
+ * The first text measured or drawn pays for fontconfig reading its caches
+ * and pango setting up a font map, which can take tens of milliseconds with
+ * many fonts installed. We do this on a separate thread whilst the menu is
+ * being loaded. The font map is thrown away afterwards, but fontconfig's
+ * configuration and caches are shared by the whole process, so the font map
+ * used for drawing is quick to set up.
+ */
+static void *warmup(void *arg)
+{
+	PangoFontMap *fontmap;
+	PangoContext *context;
+	PangoFontDescription *desc;
+	PangoFont *f;
+	PangoLanguage *lang;
+
+	fontmap = pango_cairo_font_map_new();
+	context = pango_font_map_create_context(fontmap);
+	desc = pango_font_description_from_string(font.buf);
+	f = pango_font_map_load_font(fontmap, context, desc);
+	if (f) {
+		/* glyph coverage is needed to lay out text */
+		lang = pango_language_get_default();
+		pango_coverage_unref(pango_font_get_coverage(f, lang));
+		g_object_unref(f);
+	}
+	pango_font_description_free(desc);
+	g_object_unref(context);
+	g_object_unref(fontmap);
+	return NULL;
+}
+
+void font_warmup(void)
+{
+	if (warmup_running)
+		return;
+	if (pthread_create(&warmup_thread, NULL, warmup, NULL)) {
+		warn("could not create font warm-up thread");
+		return;
+	}
+	warmup_running = 1;
+}
+
 void font_cleanup(void)
 {
+	if (warmup_running)
+		pthread_join(warmup_thread, NULL);
+	warmup_running = 0;
 	xfree(font.buf);
 }
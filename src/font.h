@@ -3,6 +3,7 @@
 
 char *font_get(void);
 void font_set(void);
+void font_warmup(void);
 void font_cleanup(void);
 
 #endif /* FONT_H */
@@ -10,6 +10,19 @@
  *	- using a separate thread, load the icons into cache ("load");
  *	- when the thread is complete, obtain pointers to the cairo surfaces
  *	  (using the "get_surface" functions).
+ *
+ * Decoded surfaces are kept within a memory budget (icon_memory_max) once
+ * all icons have been loaded. Icons are handed out as 'struct icon' and
+ * their surfaces obtained with icon_surface() when drawn, which keeps a
+ * least-recently-used list. icon_trim() drops the surfaces of the least
+ * recently drawn icons until the budget is met, and icon_surface() loads
+ * them again from the path found previously (usually a symlink in
+ * ~/.cache/jgmenu/icons/), so no theme lookup is needed.
+ *
+ * Decoded icons are also written to a pack shared with other instances (see
+ * iconpack.c). Icons found in the pack need neither a theme lookup nor
+ * decoding, and whilst their surfaces are image surfaces, their pixels are
+ * mapped from the pack and are not counted towards the budget.
  */
 
 #include <librsvg/rsvg.h>
@@ -22,6 +35,7 @@
 #include "sbuf.h"
 #include "xpm-loader.h"
 #include "cache.h"
+#include "iconpack.h"
 #include "config.h"
 #include "icon.h"
 #include "banned.h"
@@ -33,10 +47,28 @@ struct icon {
 	struct sbuf path;
 	cairo_surface_t *surface;
 	struct list_head list;
+	struct list_head lru;		/* empty if not accounted for */
+	size_t bytes;
+	int evicted;
+	int in_pack;			/* loaded from the shared icon pack */
+	unsigned int last_used;
 };
 
 static struct list_head icon_cache;
 
+/* Only accessed from the main thread (see icon_trim()) */
+static LIST_HEAD(icon_lru);
+static size_t lru_bytes;
+static unsigned int generation;
+static cairo_surface_t *upload_target;
+static struct {
+	int nr_evictions;
+	int nr_reloads;
+} stats;
+
+/* Set by icon_load() on the icon thread; read after it has been joined */
+static int have_new_surfaces;
+
 static struct sbuf icon_theme;
 
 void icon_init(void)
@@ -153,6 +185,11 @@ void icon_set_name(const char *name)
 	icon->name = strdup(name);
 	sbuf_init(&icon->path);
 	icon->surface = NULL;
+	INIT_LIST_HEAD(&icon->lru);
+	icon->bytes = 0;
+	icon->evicted = 0;
+	icon->in_pack = 0;
+	icon->last_used = 0;
 	list_add(&icon->list, &icon_cache);
 }
 
@@ -167,6 +204,16 @@ cairo_surface_t *load_cairo_icon(const char *path, int icon_size)
 	return NULL;
 }
 
+static int icon_from_pack(struct icon *icon)
+{
+	icon->surface = iconpack_get(icon->name, &icon->path);
+	if (!icon->surface)
+		return 0;
+	icon->in_pack = 1;
+	have_new_surfaces = 1;
+	return 1;
+}
+
 void icon_load(void)
 {
 	struct icon *icon;
@@ -188,6 +235,7 @@ void icon_load(void)
 			icon_find_print_themes();
 		first_load = 0;
 	}
+	iconpack_open(icon_theme.buf, config.icon_size);
 
 	sbuf_init(&s);
 
@@ -195,13 +243,17 @@ void icon_load(void)
 	list_for_each_entry(icon, &icon_cache, list) {
 		if (icon->name)
 			sbuf_cpy(&icon->path, icon->name);
-		/* Do not lookup icons with a NULL name or a full path. */
-		if (!icon->name || icon->name[0] == '\0' ||
-		    strchr(icon->name, '/'))
+		if (!icon->name || icon->name[0] == '\0')
 			continue;
 		/* icon_load is run twice, so let's not duplicate effort */
 		if (icon->surface)
 			continue;
+		/* evicted icons are reloaded by icon_get_surface() */
+		if (icon->evicted ? icon->in_pack : icon_from_pack(icon))
+			continue;
+		/* Do not lookup icons with a full path. */
+		if (strchr(icon->name, '/'))
+			continue;
 		/* Try to find icon symlink in jgmenu-cache, so save lookup */
 		if (cache_strdup_path(icon->name, &icon->path))
 			continue;
@@ -234,29 +286,198 @@ void icon_load(void)
 	}
 	list_for_each_entry(icon, &icon_cache, list) {
 		/* icon_load is run twice, so let's not duplicate effort */
-		if (icon->surface)
+		if (icon->surface || icon->evicted)
 			continue;
 		icon->surface = load_cairo_icon(icon->path.buf,
 						config.icon_size);
+		if (icon->surface) {
+			iconpack_add(icon->name, icon->path.buf, icon->surface);
+			have_new_surfaces = 1;
+		}
 	}
+	iconpack_write();
 
 	free(s.buf);
 }
 
+static cairo_surface_t *upload_surface(cairo_surface_t *image)
+{
+	cairo_surface_t *similar;
+	cairo_t *c;
+
+	similar = cairo_surface_create_similar(upload_target,
+			CAIRO_CONTENT_COLOR_ALPHA,
+			cairo_image_surface_get_width(image),
+			cairo_image_surface_get_height(image));
+	c = cairo_create(similar);
+	cairo_set_source_surface(c, image, 0, 0);
+	cairo_set_operator(c, CAIRO_OPERATOR_SOURCE);
+	cairo_paint(c);
+	cairo_destroy(c);
+	cairo_surface_destroy(image);
+	return similar;
+}
+
+/*
+ * Replace the image surfaces of loaded icons with surfaces similar to
+ * @target, so that with the xlib backend the pixels are sent to the X server
+ * once rather than on every draw. Must be called from the main thread, after
+ * icon_load() has completed, and before pointers are obtained with
+ * icon_get_surface(). Icons which are loaded again after being evicted are
+ * uploaded in the same way.
+ */
+void icon_upload(cairo_surface_t *target)
+{
+	struct icon *icon;
+
+	if (cairo_surface_get_type(target) != CAIRO_SURFACE_TYPE_XLIB)
+		return;
+	upload_target = target;
+	list_for_each_entry(icon, &icon_cache, list) {
+		if (!icon->surface ||
+		    cairo_surface_get_type(icon->surface) != CAIRO_SURFACE_TYPE_IMAGE)
+			continue;
+		icon->surface = upload_surface(icon->surface);
+	}
+}
+
 cairo_surface_t *icon_get_surface(const char *name)
 {
 	struct icon *icon;
 
+	icon = icon_get(name);
+	return icon ? icon->surface : NULL;
+}
+
+struct icon *icon_get(const char *name)
+{
+	struct icon *icon;
+
 	if (!name)
 		return NULL;
 
 	list_for_each_entry(icon, &icon_cache, list)
 		if (!strcmp(icon->name, name))
-			return icon->surface;
+			return icon;
 
 	return NULL;
 }
 
+static size_t surface_bytes(cairo_surface_t *surface)
+{
+	if (cairo_surface_get_type(surface) == CAIRO_SURFACE_TYPE_XLIB)
+		return cairo_xlib_surface_get_width(surface) *
+		       cairo_xlib_surface_get_height(surface) * 4;
+	return cairo_image_surface_get_stride(surface) *
+	       cairo_image_surface_get_height(surface);
+}
+
+/* Pixels mapped from the icon pack are shared, so do not count them */
+static int is_mapped(struct icon *icon)
+{
+	return icon->in_pack &&
+	       cairo_surface_get_type(icon->surface) == CAIRO_SURFACE_TYPE_IMAGE;
+}
+
+static void lru_add_tail(struct icon *icon)
+{
+	icon->bytes = surface_bytes(icon->surface);
+	lru_bytes += icon->bytes;
+	list_add_tail(&icon->lru, &icon_lru);
+}
+
+/* Account for surfaces loaded by icon_load() which have not been drawn yet */
+static void lru_add_new_surfaces(void)
+{
+	struct icon *icon;
+
+	if (!have_new_surfaces)
+		return;
+	have_new_surfaces = 0;
+	list_for_each_entry(icon, &icon_cache, list)
+		if (icon->surface && list_empty(&icon->lru) && !is_mapped(icon))
+			lru_add_tail(icon);
+}
+
+cairo_surface_t *icon_surface(struct icon *icon)
+{
+	if (!icon)
+		return NULL;
+	if (icon->evicted) {
+		icon->surface = NULL;
+		if (icon->in_pack)
+			icon->surface = iconpack_get(icon->name, &icon->path);
+		/* the icon may have changed since it was put in the pack */
+		if (!icon->surface) {
+			icon->in_pack = 0;
+			icon->surface = load_cairo_icon(icon->path.buf, config.icon_size);
+		}
+		if (icon->surface && upload_target)
+			icon->surface = upload_surface(icon->surface);
+		icon->evicted = 0;
+		stats.nr_reloads++;
+	}
+	if (!icon->surface)
+		return NULL;
+	if (is_mapped(icon))
+		return icon->surface;
+	if (list_empty(&icon->lru))
+		lru_add_tail(icon);
+	list_move(&icon->lru, &icon_lru);
+	icon->last_used = generation;
+	return icon->surface;
+}
+
+void icon_trim(void)
+{
+	struct icon *icon;
+	size_t budget = (size_t)config.icon_memory_max * 1024;
+
+	lru_add_new_surfaces();
+	while (config.icon_memory_max && lru_bytes > budget && !list_empty(&icon_lru)) {
+		icon = list_last_entry(&icon_lru, struct icon, lru);
+		/* do not evict icons drawn since the last trim */
+		if (icon->last_used == generation)
+			break;
+		list_del_init(&icon->lru);
+		lru_bytes -= icon->bytes;
+		cairo_surface_destroy(icon->surface);
+		icon->surface = NULL;
+		icon->evicted = 1;
+		stats.nr_evictions++;
+	}
+	generation++;
+}
+
+void icon_stats(struct sbuf *s)
+{
+	struct icon *icon;
+	int nr_icons = 0, nr_loaded = 0, nr_evicted = 0, nr_mapped = 0;
+	char buf[256];
+
+	lru_add_new_surfaces();
+	list_for_each_entry(icon, &icon_cache, list) {
+		nr_icons++;
+		if (icon->surface) {
+			nr_loaded++;
+			if (is_mapped(icon))
+				nr_mapped++;
+		} else if (icon->evicted) {
+			nr_evicted++;
+		}
+	}
+	snprintf(buf, sizeof(buf), "icons: %d names, %d loaded (%d mapped from pack), %d evicted\n",
+		 nr_icons, nr_loaded, nr_mapped, nr_evicted);
+	sbuf_addstr(s, buf);
+	snprintf(buf, sizeof(buf), "icon memory: %zu kB used, %d kB budget%s\n",
+		 lru_bytes / 1024, config.icon_memory_max,
+		 config.icon_memory_max ? "" : " (unlimited)");
+	sbuf_addstr(s, buf);
+	snprintf(buf, sizeof(buf), "icon evictions: %d, reloads: %d\n",
+		 stats.nr_evictions, stats.nr_reloads);
+	sbuf_addstr(s, buf);
+}
+
 void icon_cleanup(void)
 {
 	struct icon *icon, *tmp_icon;
@@ -266,6 +487,7 @@ void icon_cleanup(void)
 		list_del(&icon->list);
 		xfree(icon);
 	}
+	iconpack_cleanup();
 	icon_find_cleanup();
 	cache_atexit_cleanup();
 }
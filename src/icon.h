@@ -11,7 +11,32 @@ void icon_set_size(int size);
 void icon_set_name(const char *name);
 cairo_surface_t *load_cairo_icon(const char *path, int icon_size);
 void icon_load(void);
+void icon_upload(cairo_surface_t *target);
 cairo_surface_t *icon_get_surface(const char *name);
+
+struct icon;
+struct sbuf;
+
+/* icon_get - handle for icon @name (or NULL); the icon need not be loaded */
+struct icon *icon_get(const char *name);
+
+/**
+ * icon_surface - surface of @icon for drawing, or NULL if there is none
+ * The icon is loaded again if it has been evicted. The pointer is only
+ * valid until the next icon_trim() unless a reference is taken.
+ */
+cairo_surface_t *icon_surface(struct icon *icon);
+
+/**
+ * icon_trim - evict the least recently drawn icons until the surfaces fit
+ * within config.icon_memory_max. Icons drawn since the previous call are
+ * kept. Must not be called whilst icon_load() is running.
+ */
+void icon_trim(void);
+
+/* icon_stats - append a description of icon memory use to @s */
+void icon_stats(struct sbuf *s);
+
 void icon_cleanup(void);
 
 #endif /* ICON_H */
@@ -0,0 +1,479 @@
+/*
+ * iconpack.c
+ *
+ * Copyright (C) Johan Malm 2019
+ *
+ * File format (native byte order, as it never leaves the machine):
+ *	- struct pack_header
+ *	- struct pack_entry[nr_entries], sorted by name
+ *	- NUL-terminated names and source filenames
+ *	- ARGB32 pixel data for each icon, aligned to PIXEL_ALIGN bytes
+ *
+ * There is one pack for each icon theme and size. Both are recorded in the
+ * header, and a pack which does not match is not used. Each entry records
+ * the modification time and size of the file it was decoded from, and is
+ * ignored if that file has changed since.
+ *
+ * The pack is replaced with rename() rather than modified in place, so a
+ * mapping stays valid for as long as it is held. Instances which start
+ * at the same time may each decode an icon, but only the first to take the
+ * lock adds it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "iconpack.h"
+#include "cache.h"
+#include "config.h"
+#include "list.h"
+#include "sbuf.h"
+#include "util.h"
+#include "banned.h"
+
+#define LOCK_FILENAME ".jgmenu-icons.lock"
+#define PACK_MAGIC (0x6b70676a)		/* "jgpk" */
+#define PACK_VERSION (2)
+#define PIXEL_ALIGN (16)
+#define THEME_MAX (64)
+
+struct pack_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nr_entries;
+	int32_t icon_size;
+	uint64_t size;
+	char icon_theme[THEME_MAX];
+};
+
+struct pack_entry {
+	uint64_t pixels;
+	int64_t mtime;			/* of the source file */
+	uint64_t file_size;		/* of the source file */
+	uint32_t name;
+	uint32_t path;			/* source filename */
+	int32_t width;
+	int32_t height;
+	int32_t stride;
+	uint32_t reserved;
+};
+
+struct pack {
+	unsigned char *base;
+	size_t size;
+	struct pack_entry *entries;
+	uint32_t nr_entries;
+};
+
+/* An icon to be written to the pack */
+struct pack_item {
+	const char *name;
+	const char *path;
+	int64_t mtime;
+	uint64_t file_size;
+	const unsigned char *pixels;
+	int width, height, stride;
+	int queued;
+};
+
+struct queued_icon {
+	char *name;
+	char *path;
+	struct stat sb;
+	cairo_surface_t *image;
+	struct list_head list;
+};
+
+static struct pack pack;
+static int pack_opened;
+static struct sbuf pack_filename;
+static char icon_theme[THEME_MAX];
+static int icon_size;
+static LIST_HEAD(queue);
+
+static int string_is_valid(struct pack *p, uint32_t offset)
+{
+	size_t strings_start = sizeof(struct pack_header) +
+			       p->nr_entries * sizeof(struct pack_entry);
+
+	return offset >= strings_start && offset < p->size &&
+	       memchr(p->base + offset, '\0', p->size - offset);
+}
+
+static int entry_is_valid(struct pack *p, struct pack_entry *e)
+{
+	if (e->width <= 0 || e->height <= 0 ||
+	    e->stride != cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, e->width))
+		return 0;
+	if (!string_is_valid(p, e->name) || !string_is_valid(p, e->path))
+		return 0;
+	if (e->pixels % PIXEL_ALIGN || e->pixels > p->size ||
+	    (uint64_t)e->stride * e->height > p->size - e->pixels)
+		return 0;
+	return 1;
+}
+
+static int pack_map(struct pack *p, const char *filename)
+{
+	struct pack_header *h;
+	struct stat sb;
+	uint32_t i;
+	int fd;
+
+	memset(p, 0, sizeof(*p));
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	if (fstat(fd, &sb) == -1 || sb.st_size < (off_t)sizeof(struct pack_header)) {
+		close(fd);
+		return -1;
+	}
+	p->base = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p->base == MAP_FAILED) {
+		p->base = NULL;
+		return -1;
+	}
+	p->size = sb.st_size;
+	h = (struct pack_header *)p->base;
+	if (h->magic != PACK_MAGIC || h->version != PACK_VERSION || h->size != p->size ||
+	    h->nr_entries > (p->size - sizeof(*h)) / sizeof(struct pack_entry))
+		goto invalid;
+	/* should only happen on a hash collision of theme names */
+	if (h->icon_size != icon_size || strncmp(h->icon_theme, icon_theme, THEME_MAX)) {
+		munmap(p->base, p->size);
+		memset(p, 0, sizeof(*p));
+		return -1;
+	}
+	p->entries = (struct pack_entry *)(p->base + sizeof(*h));
+	p->nr_entries = h->nr_entries;
+	for (i = 0; i < p->nr_entries; i++)
+		if (!entry_is_valid(p, &p->entries[i]))
+			goto invalid;
+	return 0;
+invalid:
+	warn("ignoring invalid icon pack '%s'", filename);
+	munmap(p->base, p->size);
+	memset(p, 0, sizeof(*p));
+	return -1;
+}
+
+static void pack_unmap(struct pack *p)
+{
+	if (p->base)
+		munmap(p->base, p->size);
+	memset(p, 0, sizeof(*p));
+}
+
+static const char *entry_name(struct pack *p, struct pack_entry *e)
+{
+	return (const char *)p->base + e->name;
+}
+
+static const char *entry_path(struct pack *p, struct pack_entry *e)
+{
+	return (const char *)p->base + e->path;
+}
+
+static struct pack_entry *pack_find(struct pack *p, const char *name)
+{
+	uint32_t lo = 0, hi = p->nr_entries, mid;
+	int cmp;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = strcmp(name, entry_name(p, &p->entries[mid]));
+		if (!cmp)
+			return &p->entries[mid];
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return NULL;
+}
+
+static unsigned int theme_hash(const char *theme)
+{
+	unsigned int hash = 2166136261u;
+
+	for (; *theme; theme++)
+		hash = (hash ^ (unsigned char)*theme) * 16777619u;
+	return hash;
+}
+
+void iconpack_open(const char *theme, int size)
+{
+	char filename[64];
+
+	if (pack_opened)
+		return;
+	pack_opened = 1;
+	if (strlen(theme) >= THEME_MAX) {
+		info("icon theme name is too long for the icon pack");
+		return;
+	}
+	memset(icon_theme, 0, sizeof(icon_theme));
+	memcpy(icon_theme, theme, strlen(theme));
+	icon_size = size;
+	snprintf(filename, sizeof(filename), ".jgmenu-icons-%d-%08x.pack", size,
+		 theme_hash(theme));
+	sbuf_init(&pack_filename);
+	cache_path(filename, &pack_filename);
+	pack_map(&pack, pack_filename.buf);
+}
+
+static int source_is_unchanged(struct pack *p, struct pack_entry *e)
+{
+	struct stat sb;
+
+	return stat(entry_path(p, e), &sb) == 0 && sb.st_mtime == e->mtime &&
+	       (uint64_t)sb.st_size == e->file_size;
+}
+
+static struct pack_entry *find_current(const char *name)
+{
+	struct pack_entry *e;
+
+	e = pack_find(&pack, name);
+	if (!e || !source_is_unchanged(&pack, e))
+		return NULL;
+	return e;
+}
+
+cairo_surface_t *iconpack_get(const char *name, struct sbuf *path)
+{
+	struct pack_entry *e;
+
+	e = find_current(name);
+	if (!e)
+		return NULL;
+	sbuf_cpy(path, entry_path(&pack, e));
+	/* cairo does not write to surfaces which are only used as sources */
+	return cairo_image_surface_create_for_data(pack.base + e->pixels,
+						   CAIRO_FORMAT_ARGB32, e->width,
+						   e->height, e->stride);
+}
+
+void iconpack_add(const char *name, const char *path, cairo_surface_t *image)
+{
+	struct queued_icon *q;
+	struct stat sb;
+
+	if (!pack_filename.len || path[0] != '/')
+		return;
+	if (cairo_surface_get_type(image) != CAIRO_SURFACE_TYPE_IMAGE ||
+	    cairo_image_surface_get_format(image) != CAIRO_FORMAT_ARGB32)
+		return;
+	if (stat(path, &sb) < 0)
+		return;
+	q = xcalloc(1, sizeof(*q));
+	q->name = xstrdup(name);
+	q->path = xstrdup(path);
+	q->sb = sb;
+	q->image = cairo_surface_reference(image);
+	list_add_tail(&q->list, &queue);
+}
+
+static void queue_free(void)
+{
+	struct queued_icon *q, *tmp;
+
+	list_for_each_entry_safe(q, tmp, &queue, list) {
+		list_del(&q->list);
+		cairo_surface_destroy(q->image);
+		xfree(q->name);
+		xfree(q->path);
+		xfree(q);
+	}
+}
+
+/* By name, with icons from the queue first */
+static int item_cmp(const void *a, const void *b)
+{
+	const struct pack_item *x = a, *y = b;
+	int ret;
+
+	ret = strcmp(x->name, y->name);
+	return ret ? ret : y->queued - x->queued;
+}
+
+static size_t align(size_t n)
+{
+	return (n + PIXEL_ALIGN - 1) & ~(size_t)(PIXEL_ALIGN - 1);
+}
+
+static int write_padding(FILE *fp, size_t n)
+{
+	static const char zeros[PIXEL_ALIGN];
+
+	return n ? fwrite(zeros, n, 1, fp) == 1 : 1;
+}
+
+static int pack_write(const char *filename, struct pack_item *items, uint32_t nr)
+{
+	struct pack_header h;
+	struct pack_entry e;
+	size_t names = 0, pixels, offset;
+	uint32_t i;
+	FILE *fp;
+	int ok = 1;
+
+	for (i = 0; i < nr; i++)
+		names += strlen(items[i].name) + strlen(items[i].path) + 2;
+	pixels = align(sizeof(h) + nr * sizeof(e) + names);
+
+	memset(&h, 0, sizeof(h));
+	h.magic = PACK_MAGIC;
+	h.version = PACK_VERSION;
+	h.nr_entries = nr;
+	h.icon_size = icon_size;
+	memcpy(h.icon_theme, icon_theme, sizeof(h.icon_theme));
+	h.size = pixels;
+	for (i = 0; i < nr; i++)
+		h.size += align((size_t)items[i].stride * items[i].height);
+
+	fp = fopen(filename, "wb");
+	if (!fp)
+		return -1;
+	ok &= fwrite(&h, sizeof(h), 1, fp) == 1;
+	offset = sizeof(h) + nr * sizeof(e);
+	for (i = 0; i < nr; i++) {
+		memset(&e, 0, sizeof(e));
+		e.pixels = pixels;
+		e.mtime = items[i].mtime;
+		e.file_size = items[i].file_size;
+		e.name = offset;
+		offset += strlen(items[i].name) + 1;
+		e.path = offset;
+		offset += strlen(items[i].path) + 1;
+		e.width = items[i].width;
+		e.height = items[i].height;
+		e.stride = items[i].stride;
+		ok &= fwrite(&e, sizeof(e), 1, fp) == 1;
+		pixels += align((size_t)e.stride * e.height);
+	}
+	for (i = 0; i < nr; i++) {
+		ok &= fwrite(items[i].name, strlen(items[i].name) + 1, 1, fp) == 1;
+		ok &= fwrite(items[i].path, strlen(items[i].path) + 1, 1, fp) == 1;
+	}
+	ok &= write_padding(fp, align(offset) - offset);
+	for (i = 0; i < nr; i++) {
+		offset = (size_t)items[i].stride * items[i].height;
+		ok &= fwrite(items[i].pixels, offset, 1, fp) == 1;
+		ok &= write_padding(fp, align(offset) - offset);
+	}
+	if (fclose(fp) == EOF)
+		ok = 0;
+	return ok ? 0 : -1;
+}
+
+void iconpack_write(void)
+{
+	struct sbuf tmp, lock;
+	struct pack current;
+	struct queued_icon *q;
+	struct pack_item *items;
+	struct pack_entry *e;
+	uint32_t nr = 0, alloc, i;
+	int lock_fd, nr_new = 0;
+	char pid[32];
+
+	if (list_empty(&queue))
+		return;
+	sbuf_init(&tmp);
+	sbuf_init(&lock);
+	cache_path(LOCK_FILENAME, &lock);
+	lock_fd = open(lock.buf, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (lock_fd == -1 || flock(lock_fd, LOCK_EX) == -1) {
+		warn("cannot lock '%s'", lock.buf);
+		goto out;
+	}
+
+	/* another instance may have added to the pack since we mapped it */
+	pack_map(&current, pack_filename.buf);
+	alloc = current.nr_entries;
+	list_for_each_entry(q, &queue, list)
+		alloc++;
+	items = xcalloc(alloc, sizeof(struct pack_item));
+	list_for_each_entry(q, &queue, list) {
+		e = pack_find(&current, q->name);
+		if (e && e->mtime == q->sb.st_mtime &&
+		    e->file_size == (uint64_t)q->sb.st_size &&
+		    !strcmp(entry_path(&current, e), q->path))
+			continue;
+		cairo_surface_flush(q->image);
+		items[nr].name = q->name;
+		items[nr].path = q->path;
+		items[nr].mtime = q->sb.st_mtime;
+		items[nr].file_size = q->sb.st_size;
+		items[nr].pixels = cairo_image_surface_get_data(q->image);
+		items[nr].width = cairo_image_surface_get_width(q->image);
+		items[nr].height = cairo_image_surface_get_height(q->image);
+		items[nr].stride = cairo_image_surface_get_stride(q->image);
+		items[nr++].queued = 1;
+		nr_new++;
+	}
+	for (i = 0; i < current.nr_entries; i++) {
+		e = &current.entries[i];
+		items[nr].name = entry_name(&current, e);
+		items[nr].path = entry_path(&current, e);
+		items[nr].mtime = e->mtime;
+		items[nr].file_size = e->file_size;
+		items[nr].pixels = current.base + e->pixels;
+		items[nr].width = e->width;
+		items[nr].height = e->height;
+		items[nr++].stride = e->stride;
+	}
+	qsort(items, nr, sizeof(struct pack_item), item_cmp);
+	/*
+	 * Queued icons replace stale ones of the same name, and the queue may
+	 * hold the same name twice.
+	 */
+	for (i = 1; i < nr; i++) {
+		if (strcmp(items[i - 1].name, items[i].name))
+			continue;
+		if (items[i].queued)
+			nr_new--;
+		memmove(&items[i], &items[i + 1], (nr - i - 1) * sizeof(struct pack_item));
+		nr--;
+		i--;
+	}
+
+	if (nr_new) {
+		snprintf(pid, sizeof(pid), ".%d", getpid());
+		sbuf_cpy(&tmp, pack_filename.buf);
+		sbuf_addstr(&tmp, pid);
+		if (pack_write(tmp.buf, items, nr) < 0 || rename(tmp.buf, pack_filename.buf) < 0) {
+			warn("cannot write icon pack '%s'", pack_filename.buf);
+			unlink(tmp.buf);
+		} else {
+			if (config.verbosity >= 2)
+				info("added %d icons to icon pack", nr_new);
+		}
+	}
+	xfree(items);
+	pack_unmap(&current);
+out:
+	if (lock_fd != -1)
+		close(lock_fd);
+	queue_free();
+	xfree(tmp.buf);
+	xfree(lock.buf);
+}
+
+void iconpack_cleanup(void)
+{
+	queue_free();
+	pack_unmap(&pack);
+	xfree(pack_filename.buf);
+	memset(&pack_filename, 0, sizeof(pack_filename));
+	pack_opened = 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * A pack of decoded icons in the icon cache directory, which is shared by
+ * all jgmenu instances using the same icon theme and size.
+ *
+ * The pixel data is memory-mapped read-only, so the pages are shared
+ * between processes rather than each decoding the same icons into private
+ * memory. The pack is used by the icon thread whilst icons are loaded, and
+ * by the main thread once that has finished (see icon.c), but never by both
+ * at the same time.
+ */
+
+#ifndef ICONPACK_H
+#define ICONPACK_H
+
+#include <cairo.h>
+
+#include "sbuf.h"
+
+/* iconpack_open - map the pack for icon @theme and @size, if there is one */
+void iconpack_open(const char *theme, int size);
+
+/**
+ * iconpack_get - create an image surface for icon @name from the pack
+ * The pixel data is not copied, so the surface must be destroyed before
+ * iconpack_cleanup() is called. The file it was decoded from is copied to
+ * @path. Returns NULL if @name is not in the pack, or if that file has
+ * changed since it was decoded.
+ */
+cairo_surface_t *iconpack_get(const char *name, struct sbuf *path);
+
+/* iconpack_add - queue icon @name decoded from @path for iconpack_write() */
+void iconpack_add(const char *name, const char *path, cairo_surface_t *image);
+
+/**
+ * iconpack_write - add queued icons to the pack
+ * The pack on disk is replaced atomically, so others who have it mapped
+ * are not affected. Writers are serialised with flock().
+ */
+void iconpack_write(void);
+
+void iconpack_cleanup(void);
+
+#endif /* ICONPACK_H */
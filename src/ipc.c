@@ -1,6 +1,7 @@
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
 #include <stdbool.h>
 
 #include "util.h"
@@ -11,6 +12,8 @@
 #include "socket.h"
 #include "argv-buf.h"
 #include "geometry.h"
+#include "list.h"
+#include "loop.h"
 #include "banned.h"
 
 struct rect {
@@ -43,38 +46,132 @@ static void process_line(char *line)
 		setenv("TINT2_BUTTON_PANEL_Y2", value, 1);
 }
 
-static void process_buf(const char *buf)
+/*
+ * The running menu is controlled through a UNIX socket. A client connects,
+ * writes one message and then closes the connection (or shuts down its
+ * writing end). A message consists of lines, each of which is either a tint2
+ * button variable (TINT2_BUTTON_*=<value>) or a command such as "show" or
+ * "filter foo". Variables are set before any commands in the message are run,
+ * so that a command can align the menu to the button. Any reply (e.g. to
+ * "stats") is written back before the connection is closed.
+ *
+ * Clients are read from the event loop without blocking, so that one which is
+ * slow to send its message does not hold up the menu. Only CLIENTS_MAX are
+ * kept, so that clients which never finish are eventually dropped.
+ */
+#define MESSAGE_MAX (64 * 1024)
+#define CLIENTS_MAX (8)
+
+struct client {
+	int fd;
+	struct sbuf message;
+	struct list_head list;
+};
+
+static LIST_HEAD(clients);
+static int nr_clients;
+static void (*run_cmd_fn)(char *cmd, struct sbuf *reply);
+
+static void process_message(char *message, struct sbuf *reply,
+			    void (*run_cmd)(char *cmd, struct sbuf *reply))
 {
 	int i;
 	struct argv_buf a;
 
 	argv_set_delim(&a, '\n');
 	argv_init(&a);
-	argv_strdup(&a, buf);
+	argv_strdup(&a, message);
 	argv_parse(&a);
 	for (i = 0; i < a.argc; i++)
-		process_line(a.argv[i]);
+		if (!strncmp(a.argv[i], "TINT2_", 6))
+			process_line(a.argv[i]);
+	for (i = 0; i < a.argc; i++)
+		if (strncmp(a.argv[i], "TINT2_", 6) && a.argv[i][0] != '\0')
+			run_cmd(strstrip(a.argv[i]), reply);
+	argv_free(&a);
 }
 
-void ipc_read_socket(void)
+static void client_close(struct client *c)
 {
-	int client_fd;
-	ssize_t num_read;
+	loop_remove_fd(c->fd);
+	if (close(c->fd) == -1)
+		warn("close");
+	list_del(&c->list);
+	nr_clients--;
+	xfree(c->message.buf);
+	xfree(c);
+}
+
+static void client_reply(struct client *c)
+{
+	struct sbuf reply;
+
+	sbuf_init(&reply);
+	process_message(c->message.buf, &reply, run_cmd_fn);
+	/* the reply is small, so it fits in the socket buffer */
+	if (reply.len && write(c->fd, reply.buf, reply.len) != reply.len)
+		warn("ipc: could not write reply");
+	xfree(reply.buf);
+}
+
+static void client_ready(int fd, void *data)
+{
+	struct client *c = data;
 	char buf[SOCKET_BUF_SIZE];
+	ssize_t num_read;
 
-	/* sfd is non-blocking */
-	client_fd = accept(sfd, NULL, NULL);
-	/* only proceed if tint2 button/launcher was used */
-	if (client_fd == -1)
-		return;
-	while ((num_read = read(client_fd, buf, SOCKET_BUF_SIZE)) > 0) {
+	while ((num_read = read(fd, buf, sizeof(buf) - 1)) > 0) {
 		buf[num_read] = '\0';
-		process_buf(buf);
+		sbuf_addstr(&c->message, buf);
+		if (c->message.len > MESSAGE_MAX) {
+			warn("ipc: message too long");
+			client_close(c);
+			return;
+		}
 	}
+	if (num_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return;
 	if (num_read == -1)
-		die("read");
-	if (close(client_fd) == -1)
-		warn("close");
+		warn("ipc: could not read message");
+	else
+		client_reply(c);
+	client_close(c);
+}
+
+static int set_nonblock_cloexec(int fd)
+{
+	int flags;
+
+	flags = fcntl(fd, F_GETFL);
+	if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+		return -1;
+	return fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+void ipc_read_socket(void (*run_cmd)(char *cmd, struct sbuf *reply))
+{
+	struct client *c;
+	int client_fd;
+
+	run_cmd_fn = run_cmd;
+	/* sfd is non-blocking */
+	while ((client_fd = accept(sfd, NULL, NULL)) != -1) {
+		if (set_nonblock_cloexec(client_fd) == -1) {
+			warn("ipc: error setting socket flags");
+			close(client_fd);
+			continue;
+		}
+		if (nr_clients == CLIENTS_MAX) {
+			warn("ipc: too many clients; dropping the oldest");
+			client_close(list_first_entry(&clients, struct client, list));
+		}
+		c = xcalloc(1, sizeof(*c));
+		c->fd = client_fd;
+		sbuf_init(&c->message);
+		list_add_tail(&c->list, &clients);
+		nr_clients++;
+		loop_add_fd(client_fd, client_ready, c);
+	}
 }
 
 static void make_sfd_nonblocking(void)
@@ -91,17 +188,21 @@ static void make_sfd_nonblocking(void)
 
 static void socketfile_unlink(void)
 {
-	unlink(tint2_socket_path());
+	unlink(jgmenu_socket_path());
 }
 
-void ipc_init_socket(void)
+int ipc_init_socket(void)
 {
 	socketfile_unlink();
-	sfd = unix_listen(tint2_socket_path(), 5);
-	if (sfd == -1)
-		die("unix_listen");
+	sfd = unix_listen(jgmenu_socket_path(), 5);
+	if (sfd == -1) {
+		warn("cannot listen on '%s'; the menu can only be shown with SIGUSR1",
+		     jgmenu_socket_path());
+		return -1;
+	}
 	make_sfd_nonblocking();
 	atexit(socketfile_unlink);
+	return sfd;
 }
 
 static bool ishorizontal(struct rect rect)
@@ -4,8 +4,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-void ipc_read_socket(void);
-void ipc_init_socket(void);
+/**
+ * ipc_init_socket - listen on the control socket
+ * Returns the file descriptor to wait on before calling ipc_read_socket(),
+ * or -1 (with a warning) if the socket cannot be created
+ */
+int ipc_init_socket(void);
+
+struct sbuf;
+
+/**
+ * ipc_read_socket - accept clients, whose messages are then read from the
+ * event loop (see loop.h)
+ * @run_cmd: called for each command in a message; anything added to @reply
+ *           is sent back to the client
+ */
+void ipc_read_socket(void (*run_cmd)(char *cmd, struct sbuf *reply));
 void ipc_align_based_on_env_vars(void);
 
 #endif /* IPC_H */
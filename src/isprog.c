@@ -7,6 +7,7 @@
 
 #include "isprog.h"
 #include "list.h"
+#include "util.h"
 #include "compat.h"
 #include "banned.h"
 
@@ -16,13 +17,23 @@ struct path_segment {
 };
 
 static struct list_head head;
+static int is_path_parsed;
+
+struct cached_prog {
+	char *name;
+	char *path;
+	struct list_head list;
+};
+
+static LIST_HEAD(cached_progs);
 
 static void parse_path(void)
 {
 	struct path_segment *tmp;
 	char *path, *p;
 
-	path = strdup(getenv("PATH"));
+	path = getenv("PATH");
+	path = strdup(path ? path : "");
 
 	INIT_LIST_HEAD(&head);
 
@@ -52,7 +63,6 @@ int isprog(const char *filename)
 	char prog[4096], *p;
 	struct path_segment *tmp;
 	int pos;
-	static int is_path_parsed;
 
 	if (!is_path_parsed) {
 		parse_path();
@@ -75,3 +85,42 @@ int isprog(const char *filename)
 
 	return 0;
 }
+
+static int is_executable(const char *filename)
+{
+	struct stat sb;
+
+	return stat(filename, &sb) == 0 && S_ISREG(sb.st_mode) &&
+	       access(filename, X_OK) == 0;
+}
+
+const char *isprog_lookup(const char *name)
+{
+	struct path_segment *tmp;
+	struct cached_prog *prog;
+	char filename[4096];
+
+	list_for_each_entry(prog, &cached_progs, list)
+		if (!strcmp(prog->name, name))
+			return prog->path;
+	if (!is_path_parsed) {
+		parse_path();
+		++is_path_parsed;
+	}
+	list_for_each_entry(tmp, &head, list) {
+		/* relative entries would depend on the working directory */
+		if (tmp->path[0] != '/')
+			continue;
+		if (snprintf(filename, sizeof(filename), "%s/%s", tmp->path, name) >=
+		    (int)sizeof(filename))
+			continue;
+		if (!is_executable(filename))
+			continue;
+		prog = xmalloc(sizeof(struct cached_prog));
+		prog->name = xstrdup(name);
+		prog->path = xstrdup(filename);
+		list_add(&prog->list, &cached_progs);
+		return prog->path;
+	}
+	return NULL;
+}
@@ -3,4 +3,11 @@
 
 int isprog(const char *filename);
 
+/**
+ * isprog_lookup - find program @name in $PATH
+ * Returns the full filename, or NULL if not found. Programs which are found
+ * are cached, so they do not have to be looked up again.
+ */
+const char *isprog_lookup(const char *name);
+
 #endif /* PROG_FINDER_H */
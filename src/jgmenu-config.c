@@ -38,6 +38,9 @@ static struct option options[] = {
 	{ "hide_back_items", "1" },
 	{ "columns", "1" },
 	{ "tabs", "120" },
+	{ "filter_parallel_threshold", "5000" },
+	{ "mit_shm", "0" },
+	{ "threaded_rendering", "0" },
 	{ "menu_margin_x", "0" },
 	{ "menu_margin_y", "0" },
 	{ "menu_width", "200" },
@@ -74,6 +77,7 @@ static struct option options[] = {
 	{ "icon_text_spacing", "10" },
 	{ "icon_theme", "" },
 	{ "icon_theme_fallback", "xtg" },
+	{ "icon_memory_max", "16384" },
 	{ "arrow_string", "▸" },
 	{ "arrow_width", "15" },
 	{ "color_menu_bg", "#000000 100" },
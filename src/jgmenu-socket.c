@@ -1,36 +1,108 @@
+/*
+ * jgmenu-socket.c
+ *
+ * Sends a command to a running jgmenu through its control socket (see ipc.c).
+ * Any tint2 button variables in the environment are sent along with the
+ * command, so that the menu can be aligned to the button.
+ *
+ * Usage: jgmenu-socket [<command> [<argument>]]
+ *
+ * <command> defaults to 'show'. Any reply (e.g. to 'stats') is printed to
+ * stdout. Exits with status 1 if no jgmenu is listening.
+ */
+
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 
 #include "unix_sockets.h"
 #include "socket.h"
+#include "sbuf.h"
 #include "util.h"
 #include "banned.h"
 
+static const char * const tint2_vars[] = {
+	"TINT2_BUTTON_ALIGNED_X1",
+	"TINT2_BUTTON_ALIGNED_X2",
+	"TINT2_BUTTON_ALIGNED_Y1",
+	"TINT2_BUTTON_ALIGNED_Y2",
+	"TINT2_BUTTON_PANEL_X1",
+	"TINT2_BUTTON_PANEL_X2",
+	"TINT2_BUTTON_PANEL_Y1",
+	"TINT2_BUTTON_PANEL_Y2",
+	NULL
+};
+
+static void add_tint2_vars(struct sbuf *message)
+{
+	const char * const *var;
+	char *value;
+
+	for (var = tint2_vars; *var; var++) {
+		value = getenv(*var);
+		if (!value)
+			continue;
+		sbuf_addstr(message, *var);
+		sbuf_addstr(message, "=");
+		sbuf_addstr(message, value);
+		sbuf_addstr(message, "\n");
+	}
+}
+
+/* Anyone can create the socket if it is in /tmp (see socket.c) */
+static int socket_is_ours(const char *path)
+{
+	struct stat sb;
+
+	if (lstat(path, &sb) < 0)
+		return 0;
+	return S_ISSOCK(sb.st_mode) && sb.st_uid == getuid();
+}
+
 int main(int argc, char **argv)
 {
 	int sfd;
-	ssize_t num_read;
+	struct sbuf message;
 	char buf[SOCKET_BUF_SIZE];
+	ssize_t num_read;
 	int verbosity = 0;
 	char *jgmenu_verbosity;
+	int i;
 
 	jgmenu_verbosity = getenv("JGMENU_VERBOSITY");
 	if (jgmenu_verbosity)
 		verbosity = atoi(jgmenu_verbosity);
 
-	sfd = unix_connect(tint2_socket_path(), SOCK_STREAM);
+	sbuf_init(&message);
+	add_tint2_vars(&message);
+	if (argc < 2) {
+		sbuf_addstr(&message, "show");
+	} else {
+		for (i = 1; i < argc; i++) {
+			if (i > 1)
+				sbuf_addstr(&message, " ");
+			sbuf_addstr(&message, argv[i]);
+		}
+	}
+	sbuf_addstr(&message, "\n");
+
+	if (!socket_is_ours(jgmenu_socket_path()))
+		exit(1);
+	sfd = unix_connect(jgmenu_socket_path(), SOCK_STREAM);
 	if (sfd == -1)
-		/* error connecting to tint2 UNIX socket */
+		/* no jgmenu listening */
 		exit(1);
+	if (write(sfd, message.buf, message.len) != message.len)
+		die("partial/failed write to jgmenu UNIX socket");
+	shutdown(sfd, SHUT_WR);
 	if (verbosity == 4)
-		fprintf(stderr, "[jgmenu-socket] sent:\n");
-	while ((num_read = read(STDIN_FILENO, buf, SOCKET_BUF_SIZE)) > 0) {
-		if (write(sfd, buf, num_read) != num_read)
-			die("partial/failed write to tint2 UNIX socket");
-		if (verbosity == 4)
-			fprintf(stderr, "%s", buf);
-	}
-	if (num_read == -1)
-		die("read");
+		fprintf(stderr, "[jgmenu-socket] sent:\n%s", message.buf);
+	while ((num_read = read(sfd, buf, sizeof(buf))) > 0)
+		if (write(STDOUT_FILENO, buf, num_read) != num_read)
+			die("write");
+	close(sfd);
+	xfree(message.buf);
 	exit(0);
 }
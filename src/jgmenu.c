@@ -16,13 +16,11 @@
 #include <X11/Xresource.h>
 #include <X11/Xlocale.h>
 #include <pthread.h>
-#include <sys/select.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <errno.h>
 #include <math.h>
 #include <sys/stat.h>
-#include <sys/time.h>
 
 #include "x11-ui.h"
 #include "config.h"
@@ -49,16 +47,46 @@
 #include "charset.h"
 #include "watch.h"
 #include "spawn.h"
+#include "workers.h"
+#include "render-thread.h"
+#include "prof.h"
+#include "loop.h"
 #include "banned.h"
 
 #define DEBUG_ICONS_LOADED_NOTIFICATION 0
 
+/* Number of submenu windows to create in advance */
+#define WIN_POOL_PREFILL (2)
+
+/*
+ * Time to wait after a watched file has changed before restarting a hidden
+ * menu, so that a burst of changes (e.g. a package install) costs one restart
+ */
+#define RESTART_DELAY_MS (500)
+
+/* Size of the screen in offscreen mode */
+#define OFFSCREEN_WIDTH (1920)
+#define OFFSCREEN_HEIGHT (1080)
+
 static pthread_t thread;	   /* worker thread for loading icons	  */
-static int pipe_fds[2];		   /* talk between threads + catch sig    */
+static int pipe_fds[2];		   /* talk between threads		  */
+static struct loop_timer *mouseover_timer;
+static struct loop_timer *restart_timer;
+static int watch_mask;		   /* watch.c sources which need restart  */
+static XEvent last_event;	   /* last X event processed by run()	  */
 static int sw_close_pending;
 static int menu_is_hidden;
 static int super_key_pressed;
 
+/* Icon loading and --profile state used by run() */
+static int all_icons_have_been_requested;
+static int all_icons_loaded;	   /* icon_trim() may be used		  */
+static int profile_waiting;	   /* things to finish before prof_report() */
+static int profile_frame;	   /* a frame on the render thread is one */
+
+/* Labels are cached in the colour of each state they are drawn in */
+enum label_state { LABEL_NORM, LABEL_SEL };
+
 struct item {
 	char *buf;
 	char *name;
@@ -70,7 +98,9 @@ struct item {
 /*	int start_notify;	*/
 	char *tag;
 	struct area area;
-	cairo_surface_t *icon;
+	struct icon *icon_ref;	   /* NULL in frame copies		  */
+	cairo_surface_t *icon;	   /* refreshed from icon_ref when drawn  */
+	struct text_cache label[2];	/* indexed by enum label_state */
 	int selectable;
 	struct list_head master;
 	struct list_head filter;
@@ -78,6 +108,9 @@ struct item {
 
 static struct item empty_item;
 
+/* Incremented whenever items are added to or removed from menu.master */
+static unsigned int master_gen = 1;
+
 /* A node is marked by a ^tag() and denotes the start of a submenu */
 struct node {
 	struct item *item;	   /* item that node points to		  */
@@ -86,6 +119,8 @@ struct node {
 	struct item *expanded;	   /* tracks item with sub window open    */
 	struct node *parent;
 	Window wid;
+	int itemarea_width;	   /* memoised by submenu_itemarea_width() */
+	unsigned int itemarea_width_gen;
 	struct list_head node;
 };
 
@@ -124,7 +159,10 @@ static const char jgmenu_usage[] =
 "    --vsimple             same as --simple, but also disables icons and\n"
 "                          ignores jgmenurc\n"
 "    --csv-file=<file>     specify menu file (in jgmenu flavoured CSV format)\n"
-"    --csv-cmd=<command>   specify command to producue menu data\n";
+"    --csv-cmd=<command>   specify command to producue menu data\n"
+"    --offscreen=<file>    render without a display as directed by <file>\n"
+"    --profile[=<file>]    print the time taken by each phase of start-up and\n"
+"                          optionally write it to <file> as a Chrome trace\n";
 
 static void checkout_rootnode(void);
 static void pipemenu_del_all(void);
@@ -141,6 +179,7 @@ static void init_empty_item(void)
 	empty_item.working_dir = NULL;
 	empty_item.metadata = NULL;
 	empty_item.tag = NULL;
+	empty_item.icon_ref = NULL;
 	empty_item.icon = NULL;
 	empty_item.selectable = 1;
 	empty_item.area.h = config.item_height;
@@ -148,10 +187,21 @@ static void init_empty_item(void)
 
 static void delete_empty_item(void)
 {
+	ui_text_cache_free(&empty_item.label[LABEL_NORM]);
+	ui_text_cache_free(&empty_item.label[LABEL_SEL]);
 	xfree(empty_item.name);
 	xfree(empty_item.cmd);
 }
 
+static void destroy_item(struct item *item)
+{
+	master_gen++;
+	ui_text_cache_free(&item->label[LABEL_NORM]);
+	ui_text_cache_free(&item->label[LABEL_SEL]);
+	xfree(item->buf);
+	xfree(item);
+}
+
 static void usage(void)
 {
 	printf("%s", jgmenu_usage);
@@ -364,6 +414,85 @@ static int isvisible(struct item *item)
 	return 0;
 }
 
+static int filter_ismatch_item(struct item *item)
+{
+	if (!strncmp("^checkout(", item->cmd, 10) ||
+	    !strncmp("^tag(", item->cmd, 5) ||
+	    !strncmp("^pipe(", item->cmd, 6) ||
+	    !strncmp("^back(", item->cmd, 6) ||
+	    !strncmp("^sep(", item->cmd, 5))
+		return 0;
+	return filter_ismatch(item->name) ||
+	       filter_ismatch(item->cmd) ||
+	       filter_ismatch(item->metadata);
+}
+
+/*
+ * For large menus, the items are matched in chunks on the worker threads
+ * (see workers.c). The matching only reads item data, so each job just
+ * records its results in 'ismatch' and the filter list is built afterwards
+ * in master order.
+ */
+#define FILTER_JOBS_PER_WORKER (4)
+
+static struct {
+	struct item **items;
+	unsigned char *ismatch;
+	int nr;
+	int alloc;
+	int chunk;
+} filter_jobs;
+
+static void filter_job(void *arg, int job)
+{
+	int i, end;
+
+	i = job * filter_jobs.chunk;
+	end = MIN(i + filter_jobs.chunk, filter_jobs.nr);
+	for (; i < end; i++)
+		filter_jobs.ismatch[i] = filter_ismatch_item(filter_jobs.items[i]);
+}
+
+static void filter_master_list(void)
+{
+	struct item *item;
+	int i, nr_jobs;
+
+	filter_jobs.nr = 0;
+	list_for_each_entry(item, &menu.master, master) {
+		if (filter_jobs.nr == filter_jobs.alloc) {
+			filter_jobs.alloc = (filter_jobs.alloc + 1024) * 2;
+			filter_jobs.items = xrealloc(filter_jobs.items,
+				filter_jobs.alloc * sizeof(struct item *));
+			filter_jobs.ismatch = xrealloc(filter_jobs.ismatch,
+				filter_jobs.alloc);
+		}
+		filter_jobs.items[filter_jobs.nr++] = item;
+	}
+	if (config.filter_parallel_threshold &&
+	    filter_jobs.nr >= config.filter_parallel_threshold &&
+	    workers_nr() > 1) {
+		nr_jobs = workers_nr() * FILTER_JOBS_PER_WORKER;
+		filter_jobs.chunk = (filter_jobs.nr + nr_jobs - 1) / nr_jobs;
+		nr_jobs = (filter_jobs.nr + filter_jobs.chunk - 1) /
+			  filter_jobs.chunk;
+		workers_parallel(filter_job, NULL, nr_jobs);
+	} else {
+		filter_jobs.chunk = filter_jobs.nr;
+		filter_job(NULL, 0);
+	}
+	for (i = 0; i < filter_jobs.nr; i++)
+		if (filter_jobs.ismatch[i])
+			add_if_unique(filter_jobs.items[i]);
+}
+
+static void filter_jobs_cleanup(void)
+{
+	xfree(filter_jobs.items);
+	xfree(filter_jobs.ismatch);
+	workers_cleanup();
+}
+
 static void update_filtered_list(void)
 {
 	struct item *item;
@@ -373,18 +502,7 @@ static void update_filtered_list(void)
 
 	if (filter_needle_length()) {
 		del_beyond_root();
-		list_for_each_entry(item, &menu.master, master) {
-			if (!strncmp("^checkout(", item->cmd, 10) ||
-			    !strncmp("^tag(", item->cmd, 5) ||
-			    !strncmp("^pipe(", item->cmd, 6) ||
-			    !strncmp("^back(", item->cmd, 6) ||
-			    !strncmp("^sep(", item->cmd, 5))
-				continue;
-			if (filter_ismatch(item->name) ||
-			    filter_ismatch(item->cmd) ||
-			    filter_ismatch(item->metadata))
-				add_if_unique(item);
-		}
+		filter_master_list();
 	} else {
 		list_for_each_entry(item, &menu.master, master)
 			if (item == menu.subhead)
@@ -460,6 +578,30 @@ static char *parse_caret_action(char *s, char *token)
 	return p;
 }
 
+/*
+ * A frame describes everything needed to draw a menu. The draw_*() functions
+ * below only use the frame and config, so that a frame can be rendered on
+ * another thread (see render-thread.c). Frames for that purpose hold copies
+ * of the visible items; otherwise the items are those in menu.filter.
+ */
+struct frame {
+	int w, h;
+	int is_submenu;
+	int more_above, more_below;
+	int draw_widgets;
+	int cached;			/* use text caches (main thread only) */
+	int nr_items;
+	struct item **items;
+	struct item *sel, *last_sel;
+	struct item *copies;
+};
+
+static struct text_cache *label_cache(const struct frame *f, struct item *p,
+				      enum label_state state)
+{
+	return f->cached ? &p->label[state] : NULL;
+}
+
 static void draw_item_sep_without_text(struct item *p)
 {
 	double y;
@@ -469,7 +611,7 @@ static void draw_item_sep_without_text(struct item *p)
 		     1.0, config.color_sep_fg);
 }
 
-static void draw_item_sep_with_text(struct item *p)
+static void draw_item_sep_with_text(const struct frame *f, struct item *p)
 {
 	struct sbuf s;
 	int text_x_coord;
@@ -495,22 +637,23 @@ static void draw_item_sep_with_text(struct item *p)
 	ui_draw_rectangle(p->area.x, p->area.y, p->area.w,
 			  p->area.h, config.item_radius, 1.0, 0,
 			  config.color_title_border);
-	ui_insert_text(s.buf, text_x_coord, p->area.y, p->area.h, p->area.w,
-		       config.color_title_fg, config.sep_halign);
+	ui_insert_text_cached(label_cache(f, p, LABEL_NORM), s.buf,
+			      text_x_coord, p->area.y, p->area.h, p->area.w,
+			      config.color_title_fg, config.sep_halign);
 	xfree(s.buf);
 }
 
-static void draw_item_sep(struct item *p)
+static void draw_item_sep(const struct frame *f, struct item *p)
 {
 	if (p->name[strlen("^sep(")] == '\0')
 		draw_item_sep_without_text(p);
 	else
-		draw_item_sep_with_text(p);
+		draw_item_sep_with_text(f, p);
 }
 
-static void draw_last_sel(struct item *p)
+static void draw_last_sel(const struct frame *f, struct item *p)
 {
-	if (p == menu.sel)
+	if (p == f->sel)
 		return;
 	ui_draw_rectangle(p->area.x, p->area.y, p->area.w,
 			  p->area.h, config.item_radius, 1.0,
@@ -536,7 +679,7 @@ static void draw_item_bg_sel(struct item *p)
 			  config.color_sel_border);
 }
 
-static void draw_item_text(struct item *p)
+static void draw_item_text(const struct frame *f, struct item *p)
 {
 	int text_x_coord, width;
 
@@ -552,41 +695,48 @@ static void draw_item_text(struct item *p)
 	if (config.icon_size)
 		width -= config.icon_size + config.icon_text_spacing;
 
-	if (p == menu.sel)
-		ui_insert_text(p->name, text_x_coord, p->area.y,
-			       p->area.h, width, config.color_sel_fg,
-			       config.item_halign);
+	if (p == f->sel)
+		ui_insert_text_cached(label_cache(f, p, LABEL_SEL), p->name,
+				      text_x_coord, p->area.y, p->area.h, width,
+				      config.color_sel_fg, config.item_halign);
 	else
-		ui_insert_text(p->name, text_x_coord, p->area.y,
-			       p->area.h, width, config.color_norm_fg,
-			       config.item_halign);
+		ui_insert_text_cached(label_cache(f, p, LABEL_NORM), p->name,
+				      text_x_coord, p->area.y, p->area.h, width,
+				      config.color_norm_fg, config.item_halign);
 }
 
-static void draw_submenu_arrow(struct item *p)
+static struct text_cache arrow_cache[2];
+
+static void draw_submenu_arrow(const struct frame *f, struct item *p)
 {
+	struct text_cache *cache = NULL;
 	double *color;
 
-	color = (p == menu.sel) ? config.color_sel_fg : config.color_norm_fg;
+	color = (p == f->sel) ? config.color_sel_fg : config.color_norm_fg;
+	if (f->cached)
+		cache = &arrow_cache[p == f->sel ? LABEL_SEL : LABEL_NORM];
 	if (config.item_halign != RIGHT)
-		ui_insert_text(config.arrow_string, p->area.x + p->area.w -
-			       config.item_padding_x - (config.arrow_width * 0.7), p->area.y,
-			       p->area.h, p->area.w, color,
-			       config.item_halign);
+		ui_insert_text_cached(cache, config.arrow_string,
+				      p->area.x + p->area.w - config.item_padding_x -
+				      (config.arrow_width * 0.7), p->area.y,
+				      p->area.h, p->area.w, color,
+				      config.item_halign);
 	else
-		ui_insert_text(config.arrow_string, p->area.x + config.item_padding_x,
-			       p->area.y, p->area.h, config.arrow_width * 0.7,
-			       color, config.item_halign);
+		ui_insert_text_cached(cache, config.arrow_string,
+				      p->area.x + config.item_padding_x,
+				      p->area.y, p->area.h, config.arrow_width * 0.7,
+				      color, config.item_halign);
 }
 
 static void draw_icon(struct item *p)
 {
 	int icon_y_coord;
 	int offsety, offsetx;
+	int w, h;
 
-	offsety = cairo_image_surface_get_height(p->icon) < config.icon_size ?
-		  (config.icon_size - cairo_image_surface_get_height(p->icon)) / 2 : 0;
-	offsetx = cairo_image_surface_get_width(p->icon) < config.icon_size ?
-		  (config.icon_size - cairo_image_surface_get_width(p->icon)) / 2 : 0;
+	ui_image_get_size(p->icon, &w, &h);
+	offsety = h < config.icon_size ? (config.icon_size - h) / 2 : 0;
+	offsetx = w < config.icon_size ? (config.icon_size - w) / 2 : 0;
 
 	icon_y_coord = p->area.y + (config.item_height - config.icon_size) / 2 +
 		       offsety;
@@ -598,11 +748,11 @@ static void draw_icon(struct item *p)
 				config.item_padding_x + offsetx - 1, icon_y_coord, config.icon_size);
 }
 
-static void draw_items_below_indicator(void)
+static void draw_items_below_indicator(const struct frame *f)
 {
 	int b, r, l;
 
-	if (!menu.current_node->parent) {
+	if (!f->is_submenu) {
 		b = config.menu_padding_bottom;
 		r = config.menu_padding_right;
 		l = config.menu_padding_left;
@@ -613,15 +763,15 @@ static void draw_items_below_indicator(void)
 	}
 	if (b < 1)
 		return;
-	ui_draw_line(l, geo_get_menu_height() - b - 0.5, geo_get_menu_width() - r,
-		     geo_get_menu_height() - b - 0.5, 1.0, config.color_scroll_ind);
+	ui_draw_line(l, f->h - b - 0.5, f->w - r, f->h - b - 0.5, 1.0,
+		     config.color_scroll_ind);
 }
 
-static void draw_items_above_indicator(void)
+static void draw_items_above_indicator(const struct frame *f)
 {
 	int t, r, l;
 
-	if (!menu.current_node->parent) {
+	if (!f->is_submenu) {
 		t = config.menu_padding_top;
 		r = config.menu_padding_right;
 		l = config.menu_padding_left;
@@ -632,67 +782,447 @@ static void draw_items_above_indicator(void)
 	}
 	if (t < 1)
 		return;
-	ui_draw_line(l, t + 0.5, geo_get_menu_width() - r, t + 0.5, 1.0,
+	ui_draw_line(l, t + 0.5, f->w - r, t + 0.5, 1.0,
 		     config.color_scroll_ind);
 }
 
-static void draw_menu(void)
+/*
+ * X events are processed in batches (see process_x_events()). Changes to the
+ * filter needle and selection are applied as the events are read, but
+ * re-filtering and painting are deferred until the queue has been drained.
+ */
+static struct {
+	int refilter;
+	int draw;
+	int draw_selection;
+} pending;
+
+static void schedule_update(void)
+{
+	pending.refilter = 1;
+	pending.draw = 1;
+}
+
+static void schedule_draw(void)
+{
+	pending.draw = 1;
+}
+
+/* Use when only menu.sel and/or last_sel have changed */
+static void schedule_draw_selection(void)
+{
+	pending.draw_selection = 1;
+}
+
+static void apply_pending_filter(void)
+{
+	if (!pending.refilter)
+		return;
+	pending.refilter = 0;
+	update_filtered_list();
+	init_menuitem_coordinates();
+}
+
+/*
+ * What was on the canvas after the last full draw_menu(). Used to decide
+ * whether a selection change can be painted by just redrawing the items
+ * concerned.
+ */
+static struct {
+	int valid;
+	int win;
+	struct node *node;
+	struct item *first, *last;
+	struct item *sel, *last_sel;
+	int w, h;
+	int first_y, first_h;	   /* area of 'first' */
+	int bottom;		   /* bottom edge of 'last' */
+} drawn;
+
+/* Incremented on every draw, so that stale threaded frames can be dropped */
+static unsigned int frame_seq;
+
+static int is_submenu_item(struct item *p)
+{
+	return !strncmp(p->cmd, "^checkout(", 10) ||
+	       !strncmp(p->cmd, "^pipe(", 6) ||
+	       !strncmp(p->cmd, "^root(", 6) ||
+	       !strncmp(p->cmd, "^sub(", 5);
+}
+
+/*
+ * Describe the current state of the menu. If @copy is set, the visible items
+ * are copied so that the frame does not refer to anything which the main
+ * thread may change or free.
+ */
+static struct frame *frame_create(int copy)
 {
+	struct frame *f;
 	struct item *p;
-	int w;
+	int i;
+
+	f = xcalloc(1, sizeof(struct frame));
+	f->w = geo_get_menu_width();
+	f->h = geo_get_menu_height();
+	f->is_submenu = menu.current_node->parent != NULL;
+	f->more_below = filter_tail() != menu.last;
+	f->more_above = filter_head() != menu.first;
+	f->draw_widgets = !ui->cur && !copy;
+	f->cached = !copy;
+
+	p = menu.first;
+	list_for_each_entry_from(p, &menu.filter, filter) {
+		f->nr_items++;
+		if (p == menu.last)
+			break;
+	}
+	/* both states of each label, and of the submenu arrow */
+	if (f->cached)
+		ui_text_cache_reserve(2 * f->nr_items + 2);
+	f->items = xmalloc(f->nr_items * sizeof(struct item *));
+	if (copy)
+		f->copies = xcalloc(f->nr_items, sizeof(struct item));
+	i = 0;
+	p = menu.first;
+	list_for_each_entry_from(p, &menu.filter, filter) {
+		if (p->icon_ref)
+			p->icon = icon_surface(p->icon_ref);
+		if (copy) {
+			f->items[i] = &f->copies[i];
+			f->copies[i].name = xstrdup(p->name);
+			f->copies[i].cmd = xstrdup(p->cmd);
+			f->copies[i].area = p->area;
+			f->copies[i].selectable = p->selectable;
+			if (p->icon)
+				f->copies[i].icon = cairo_surface_reference(p->icon);
+		} else {
+			f->items[i] = p;
+		}
+		if (p == menu.sel)
+			f->sel = f->items[i];
+		if (p == menu.current_node->last_sel)
+			f->last_sel = f->items[i];
+		i++;
+		if (p == menu.last)
+			break;
+	}
+	/* the visible icons have just been used, so will not be evicted */
+	if (all_icons_loaded)
+		icon_trim();
+	return f;
+}
 
-	w = geo_get_menu_width();
+static void frame_destroy(void *frame)
+{
+	struct frame *f = frame;
+	int i;
+
+	for (i = 0; f->copies && i < f->nr_items; i++) {
+		xfree(f->copies[i].name);
+		xfree(f->copies[i].cmd);
+		if (f->copies[i].icon)
+			cairo_surface_destroy(f->copies[i].icon);
+	}
+	xfree(f->copies);
+	xfree(f->items);
+	xfree(f);
+}
 
+static void draw_menu_bg(const struct frame *f)
+{
 	/* Draw background */
 	ui_clear_canvas();
-	ui_draw_rectangle(0, 0, w, geo_get_menu_height(), config.menu_radius,
+	ui_draw_rectangle(0, 0, f->w, f->h, config.menu_radius,
 			  config.menu_border, 1, config.color_menu_bg);
 
 	/* Draw menu border */
 	if (config.menu_border)
-		ui_draw_rectangle(0, 0, w, geo_get_menu_height(),
-				  config.menu_radius, config.menu_border,
-				  0, config.color_menu_border);
+		ui_draw_rectangle(0, 0, f->w, f->h, config.menu_radius,
+				  config.menu_border, 0, config.color_menu_border);
 
-	if (!ui->cur)
+	if (f->draw_widgets)
 		widgets_draw();
+}
 
-	/* Draw menu items */
-	p = menu.first;
-	list_for_each_entry_from(p, &menu.filter, filter) {
-		/* Draw item background */
-		if (p == menu.sel)
-			draw_item_bg_sel(p);
-		else if (p->selectable)
-			draw_item_bg_norm(p);
-		if (p == menu.current_node->last_sel)
-			draw_last_sel(p);
+static void draw_scroll_indicators(const struct frame *f)
+{
+	if (f->more_below)
+		draw_items_below_indicator(f);
+	if (f->more_above)
+		draw_items_above_indicator(f);
+}
 
-		/* Draw submenu arrow */
-		if (config.arrow_width && (!strncmp(p->cmd, "^checkout(", 10) ||
-					   !strncmp(p->cmd, "^pipe(", 6) ||
-					   !strncmp(p->cmd, "^root(", 6) ||
-					   !strncmp(p->cmd, "^sub(", 5)))
-			draw_submenu_arrow(p);
+static void draw_item(const struct frame *f, struct item *p)
+{
+	/* Draw item background */
+	if (p == f->sel)
+		draw_item_bg_sel(p);
+	else if (p->selectable)
+		draw_item_bg_norm(p);
+	if (p == f->last_sel)
+		draw_last_sel(f, p);
 
-		/* Draw menu items text */
-		if (p->selectable)
-			draw_item_text(p);
-		else if (!strncmp(p->name, "^sep(", 5))
-			draw_item_sep(p);
+	/* Draw submenu arrow */
+	if (config.arrow_width && is_submenu_item(p))
+		draw_submenu_arrow(f, p);
 
-		/* Draw Icons */
-		if (config.icon_size && p->icon)
-			draw_icon(p);
+	/* Draw menu items text */
+	if (p->selectable)
+		draw_item_text(f, p);
+	else if (!strncmp(p->name, "^sep(", 5))
+		draw_item_sep(f, p);
 
-		if (p == menu.last)
+	/* Draw Icons */
+	if (p->icon_ref)
+		p->icon = icon_surface(p->icon_ref);
+	if (config.icon_size && p->icon)
+		draw_icon(p);
+}
+
+static void render_frame(void *frame)
+{
+	struct frame *f = frame;
+	int i;
+
+	draw_menu_bg(f);
+	for (i = 0; i < f->nr_items; i++)
+		draw_item(f, f->items[i]);
+	draw_scroll_indicators(f);
+}
+
+static void paint_frame(cairo_surface_t *image)
+{
+	ui_canvas_paint(image);
+	ui_map_window(cairo_image_surface_get_width(image),
+		      cairo_image_surface_get_height(image));
+}
+
+/*
+ * With 'threaded_rendering', redraws of a window which has already been
+ * painted at the same size are handed to the render thread. New or resized
+ * windows are drawn straight away so that they are never shown blank.
+ * Widgets are not thread-safe, so the root menu with widgets is always
+ * drawn on the main thread.
+ */
+static int use_render_thread(void)
+{
+	return config.threaded_rendering && drawn.valid &&
+	       drawn.win == ui->cur && drawn.w == geo_get_menu_width() &&
+	       drawn.h == geo_get_menu_height() &&
+	       (ui->cur || !widgets_exist());
+}
+
+static void draw_menu(void)
+{
+	struct frame *f;
+
+	pending.draw = 0;
+	pending.draw_selection = 0;
+	frame_seq++;
+
+	if (use_render_thread()) {
+		render_thread_init(render_frame, frame_destroy, font_get(),
+				   pipe_fds[1]);
+		f = frame_create(1);
+		render_thread_submit(f, frame_seq, f->w, f->h);
+		/* the first frame submitted whilst profiling is shown later */
+		if (profile_waiting && !profile_frame++)
+			profile_waiting++;
+	} else {
+		ui_canvas_ensure(geo_get_menu_width(), geo_get_menu_height());
+		f = frame_create(0);
+		render_frame(f);
+		frame_destroy(f);
+		ui_map_window(geo_get_menu_width(), geo_get_menu_height());
+	}
+
+	drawn.valid = 1;
+	drawn.win = ui->cur;
+	drawn.node = menu.current_node;
+	drawn.first = menu.first;
+	drawn.last = menu.last;
+	drawn.sel = menu.sel;
+	drawn.last_sel = menu.current_node->last_sel;
+	drawn.w = geo_get_menu_width();
+	drawn.h = geo_get_menu_height();
+	drawn.first_y = menu.first->area.y;
+	drawn.first_h = menu.first->area.h;
+	drawn.bottom = menu.last->area.y + menu.last->area.h;
+}
+
+/* Repaint everything under one item, clipped to its area */
+static void redraw_item(const struct frame *f, struct item *p)
+{
+	ui_clip_push(p->area.x, p->area.y, p->area.w, p->area.h);
+	draw_menu_bg(f);
+	draw_item(f, p);
+	draw_scroll_indicators(f);
+	ui_clip_pop();
+	ui_damage_add(p->area.x, p->area.y, p->area.w, p->area.h);
+}
+
+/* Repaint everything between rows y0 and y1 */
+static void redraw_band(const struct frame *f, int y0, int y1)
+{
+	int i;
+	struct item *p;
+
+	if (y1 <= y0)
+		return;
+	ui_clip_push(0, y0, f->w, y1 - y0);
+	draw_menu_bg(f);
+	for (i = 0; i < f->nr_items; i++) {
+		p = f->items[i];
+		if (p->area.y < y1 && p->area.y + p->area.h > y0)
+			draw_item(f, p);
+	}
+	draw_scroll_indicators(f);
+	ui_clip_pop();
+}
+
+/* Redraw the items which were or have become (last-)selected */
+static void redraw_selection(const struct frame *f, int visible_only)
+{
+	struct item *items[4];
+	int i, j, nr = 0;
+
+	items[nr++] = drawn.sel;
+	items[nr++] = drawn.last_sel;
+	items[nr++] = menu.sel;
+	items[nr++] = menu.current_node->last_sel;
+	for (i = 0; i < nr; i++) {
+		if (!items[i])
+			continue;
+		if (visible_only && !isvisible(items[i]))
+			continue;
+		for (j = 0; j < i; j++)
+			if (items[j] == items[i])
+				break;
+		if (j == i)
+			redraw_item(f, items[i]);
+	}
+}
+
+static struct item *filter_next(struct item *p)
+{
+	if (p->filter.next == &menu.filter)
+		return NULL;
+	return container_of(p->filter.next, struct item, filter);
+}
+
+static struct item *filter_prev(struct item *p)
+{
+	if (p->filter.prev == &menu.filter)
+		return NULL;
+	return container_of(p->filter.prev, struct item, filter);
+}
+
+/*
+ * Paint a scroll by one item by moving the rows which remain visible and
+ * just drawing the rest (the new row, paddings and the selection). This
+ * relies on items being stacked in a single column, and on the rounded
+ * corners of the menu not reaching into the rows which are moved.
+ * Returns -1 if the scroll cannot be painted this way.
+ */
+static int draw_scroll(void)
+{
+	struct item *shared, *p;
+	struct frame *f;
+	int old_y, dy, src_y0, src_y1, valid_end;
+
+	if (config.columns != 1 || (!ui->cur && widgets_exist()))
+		return -1;
+	if (menu.first == filter_next(drawn.first)) {
+		/* scrolling down - 'first' was the second item */
+		shared = menu.first;
+		old_y = drawn.first_y + drawn.first_h + config.item_margin_y;
+	} else if (menu.first == filter_prev(drawn.first)) {
+		shared = drawn.first;
+		old_y = drawn.first_y;
+	} else {
+		return -1;
+	}
+	dy = shared->area.y - old_y;
+	if (!dy)
+		return -1;
+	src_y0 = dy < 0 ? old_y : drawn.first_y;
+	src_y1 = dy < 0 ? drawn.bottom : drawn.bottom - dy;
+	if (src_y1 <= src_y0 ||
+	    src_y0 + (dy < 0 ? dy : 0) < config.menu_radius ||
+	    src_y1 + (dy > 0 ? dy : 0) > geo_get_menu_height() - config.menu_radius)
+		return -1;
+
+	/* find the end of the items which were visible and have been moved */
+	valid_end = src_y0 + dy;
+	p = shared;
+	list_for_each_entry_from(p, &menu.filter, filter) {
+		if (p->area.y + p->area.h > src_y1 + dy)
+			break;
+		valid_end = p->area.y + p->area.h;
+		if (p == drawn.last || p == menu.last)
 			break;
 	}
-	if (filter_tail() != menu.last)
-		draw_items_below_indicator();
-	if (filter_head() != menu.first)
-		draw_items_above_indicator();
+
+	frame_seq++;
+	ui_canvas_scroll(src_y0, src_y1 - src_y0, dy);
+	f = frame_create(0);
+	redraw_band(f, 0, src_y0 + dy);
+	redraw_band(f, valid_end, f->h);
+	redraw_selection(f, 1);
+	frame_destroy(f);
 	ui_map_window(geo_get_menu_width(), geo_get_menu_height());
+
+	drawn.first = menu.first;
+	drawn.last = menu.last;
+	drawn.sel = menu.sel;
+	drawn.last_sel = menu.current_node->last_sel;
+	drawn.first_y = menu.first->area.y;
+	drawn.first_h = menu.first->area.h;
+	drawn.bottom = menu.last->area.y + menu.last->area.h;
+	return 0;
+}
+
+/*
+ * Paint a change of menu.sel and/or last_sel by redrawing only the items
+ * which were or have become (last-)selected, and copying just those areas to
+ * the window. Scrolling by one item is handled by draw_scroll(). Anything
+ * else which has changed since the last draw_menu() (a different node or
+ * window, a resize) requires a full redraw.
+ */
+static void draw_selection(void)
+{
+	struct frame *f;
+
+	pending.draw_selection = 0;
+	if (!drawn.valid || drawn.win != ui->cur ||
+	    drawn.node != menu.current_node || drawn.w != geo_get_menu_width() ||
+	    drawn.h != geo_get_menu_height() || use_render_thread()) {
+		draw_menu();
+		return;
+	}
+	if (drawn.first != menu.first || drawn.last != menu.last) {
+		if (draw_scroll() < 0)
+			draw_menu();
+		return;
+	}
+	frame_seq++;
+
+	f = frame_create(0);
+	redraw_selection(f, 0);
+	frame_destroy(f);
+	ui_present();
+
+	drawn.sel = menu.sel;
+	drawn.last_sel = menu.current_node->last_sel;
+}
+
+static void flush_pending(void)
+{
+	apply_pending_filter();
+	if (pending.draw)
+		draw_menu();
+	else if (pending.draw_selection)
+		draw_selection();
 }
 
 static struct node *get_node_from_tag(const char *tag)
@@ -714,6 +1244,9 @@ static int submenu_itemarea_width(void)
 	struct sbuf s;
 	struct point point;
 
+	if (menu.current_node->itemarea_width_gen == master_gen)
+		return menu.current_node->itemarea_width;
+
 	sbuf_init(&s);
 	p = menu.subhead;
 	list_for_each_entry_from(p, &menu.master, master) {
@@ -733,6 +1266,8 @@ static int submenu_itemarea_width(void)
 		point.x += config.icon_size + config.icon_text_spacing;
 	point.x += config.arrow_width;
 	free(s.buf);
+	menu.current_node->itemarea_width = point.x;
+	menu.current_node->itemarea_width_gen = master_gen;
 	return point.x;
 }
 
@@ -884,12 +1419,23 @@ static void checkout_submenu(char *tag)
 	set_submenu_height();
 	set_submenu_width();
 	ui_win_add(geo_get_menu_x0(), geo_get_menu_y0(),
-		   geo_get_menu_width(), geo_get_menu_height(),
-		   geo_get_screen_width(), geo_get_screen_height(),
-		   font_get());
+		   geo_get_menu_width(), geo_get_menu_height(), font_get());
 	menu.current_node->wid = ui->w[ui->cur].win;
 }
 
+/*
+ * Closed windows are re-used for new submenus, so nodes must not keep
+ * referring to them.
+ */
+static void forget_closed_windows(void)
+{
+	struct node *n;
+
+	list_for_each_entry(n, &menu.nodes, node)
+		if (n->wid && !ui_win_is_open(n->wid))
+			n->wid = 0;
+}
+
 static void checkout_parentmenu(char *tag)
 {
 	checkout_tag(tag);
@@ -898,6 +1444,7 @@ static void checkout_parentmenu(char *tag)
 		return;
 	geo_win_del();
 	ui_win_del();
+	forget_closed_windows();
 }
 
 static void checkout_rootmenu(char *tag)
@@ -919,13 +1466,13 @@ static void checkout_rootnode(void)
 
 static void resize(void)
 {
-	XMoveResizeWindow(ui->dpy, ui->w[ui->cur].win, geo_get_menu_x0(),
-			  geo_get_menu_y0(), geo_get_menu_width(),
-			  geo_get_menu_height());
+	ui_win_move_resize(geo_get_menu_x0(), geo_get_menu_y0(),
+			   geo_get_menu_width(), geo_get_menu_height());
 }
 
 static void update(int resize_required)
 {
+	pending.refilter = 0;
 	update_filtered_list();
 	init_menuitem_coordinates();
 	draw_menu();
@@ -935,17 +1482,62 @@ static void update(int resize_required)
 	ui_map_window(geo_get_menu_width(), geo_get_menu_height());
 }
 
-static void launch_menu_at_pointer(void)
+/*
+ * The pointer is grabbed on the root window, so the x and y of pointer events
+ * are relative to the root window rather than to the menu window under the
+ * pointer. We keep track of the root coordinates of the pointer and translate
+ * them to the current window, so that we do not need a round-trip to the X
+ * server for each event.
+ */
+static struct point pointer_root;
+
+static void pointer_init(void)
 {
 	Window dw;
 	int di;
 	unsigned int du;
+
+	XQueryPointer(ui->dpy, ui->root, &dw, &dw, &pointer_root.x,
+		      &pointer_root.y, &di, &di, &du);
+}
+
+static void pointer_track(XEvent *ev)
+{
+	switch (ev->type) {
+	case MotionNotify:
+		pointer_root.x = ev->xmotion.x_root;
+		pointer_root.y = ev->xmotion.y_root;
+		break;
+	case ButtonPress:
+	case ButtonRelease:
+		pointer_root.x = ev->xbutton.x_root;
+		pointer_root.y = ev->xbutton.y_root;
+		break;
+	case EnterNotify:
+	case LeaveNotify:
+		pointer_root.x = ev->xcrossing.x_root;
+		pointer_root.y = ev->xcrossing.y_root;
+		break;
+	}
+}
+
+static struct point mousexy(void)
+{
+	struct point coords;
+
+	coords.x = pointer_root.x - ui->w[ui->cur].x;
+	coords.y = pointer_root.y - ui->w[ui->cur].y;
+	return coords;
+}
+
+static void launch_menu_at_pointer(void)
+{
 	struct point pos;
 	struct area wa;
 
 	geo_update_monitor_coords();
-	XQueryPointer(ui->dpy, DefaultRootWindow(ui->dpy), &dw, &dw, &di, &di,
-		      &pos.x, &pos.y, &du);
+	pointer_init();		/* also used by awake_menu() */
+	pos = pointer_root;
 	if (pos.x < config.edge_snap_x)
 		pos.x = 0;
 
@@ -1010,21 +1602,38 @@ static void if_unity_run_hack(void)
 		spawn("jgmenu_run unity-hack", NULL);
 }
 
+/*
+ * hide_menu() leaves the root menu drawn on the canvas, so if the menu is
+ * still the same size once it has been positioned, it just needs to be moved
+ * and mapped. Otherwise, it has to be laid out and drawn again before it is
+ * mapped, as showing the old frame first would briefly show a menu of the
+ * wrong size, with items cut off or the window growing under the pointer.
+ *
+ * Only the one frame is kept. The position mode cannot change without a
+ * restart, and the size only changes when the space available where the menu
+ * is shown does (e.g. near a screen edge or on a smaller monitor), so a frame
+ * per mode or monitor would cost a canvas each for little gain.
+ */
 static void awake_menu(void)
 {
+	int w = geo_get_menu_width();
+	int h = geo_get_menu_height();
+
 	menu_is_hidden = 0;
 	if_unity_run_hack();
-	if (watch_files_have_changed())
+	if (watch_changes() & watch_mask)
 		restart();
-	if (config.position_mode == POSITION_MODE_PTR) {
+	/* pointer_root is still where the pointer was when the menu was hidden */
+	if (config.position_mode == POSITION_MODE_PTR)
 		launch_menu_at_pointer();
-		resize();
-	}
-	ipc_read_socket();
-	if (config.position_mode == POSITION_MODE_IPC) {
+	else
+		pointer_init();
+	if (config.position_mode == POSITION_MODE_IPC)
 		ipc_align_based_on_env_vars();
+	if (geo_get_menu_width() != w || geo_get_menu_height() != h)
 		update(1);
-	}
+	else
+		resize();
 	XMapWindow(ui->dpy, ui->w[ui->cur].win);
 	ui_map_window(geo_get_menu_width(), geo_get_menu_height());
 	XRaiseWindow(ui->dpy, ui->w[ui->cur].win);
@@ -1055,6 +1664,7 @@ static void create_node(const char *name, struct node *parent)
 	n->expanded = NULL;
 	n->parent = parent;
 	n->wid = 0;
+	n->itemarea_width_gen = 0;
 	list_add_tail(&n->node, &menu.nodes);
 }
 
@@ -1099,6 +1709,7 @@ static void destroy_node_tree(void)
 		list_del(&n->node);
 		xfree(n);
 	}
+	drawn.valid = 0;
 }
 
 static void build_tree(void)
@@ -1138,9 +1749,8 @@ void remove_checkouts_without_matching_tags(void)
 		if (!strncmp(i->cmd, "^checkout(", 10) &&
 		    !tag_exists(i->cmd + 10)) {
 			info("remove (%s) as it has no matching tag", i->cmd);
-			xfree(i->buf);
 			list_del(&i->master);
-			xfree(i);
+			destroy_item(i);
 		}
 	}
 }
@@ -1181,11 +1791,14 @@ static void insert_tag_item(void)
 	item->iconname = NULL;
 	item->working_dir = NULL;
 	item->metadata = NULL;
+	item->icon_ref = NULL;
 	item->icon = NULL;
+	memset(&item->label, 0, sizeof(item->label));
 	item->tag = item->cmd + 5;
 	item->selectable = 1;
 	item->area.h = config.item_height;
 	list_add_tail(&item->master, &menu.master);
+	master_gen++;
 }
 
 static void resolve_newline(char *s)
@@ -1263,6 +1876,7 @@ static int read_csv_file(FILE *fp, bool ispipemenu)
 		argv_strdup(&argv_buf, buf);
 		argv_parse(&argv_buf);
 		item = xmalloc(sizeof(struct item));
+		memset(&item->label, 0, sizeof(item->label));
 		item->buf = argv_buf.buf;
 		item->name = argv_buf.argv[0];
 		resolve_newline(item->name);
@@ -1279,6 +1893,7 @@ static int read_csv_file(FILE *fp, bool ispipemenu)
 				insert_tag_item();
 			first_item = false;
 		}
+		item->icon_ref = NULL;
 		item->icon = NULL;
 		if (!strncmp("^tag(", item->cmd, 5))
 			item->tag = parse_caret_action(item->cmd, "^tag(");
@@ -1292,6 +1907,7 @@ static int read_csv_file(FILE *fp, bool ispipemenu)
 				item->area.h = config.sep_height;
 		}
 		list_add_tail(&item->master, &menu.master);
+		master_gen++;
 	}
 
 	return i;
@@ -1303,9 +1919,8 @@ static void rm_back_items(void)
 
 	list_for_each_entry_safe(i, tmp, &menu.master, master) {
 		if (!strncmp(i->cmd, "^back(", 6)) {
-			xfree(i->buf);
 			list_del(&i->master);
-			xfree(i);
+			destroy_item(i);
 		}
 	}
 }
@@ -1339,6 +1954,7 @@ static void recalc_expanded_nodes(void)
 static void del_beyond_current(void)
 {
 	ui_win_del_beyond(ui->cur);
+	forget_closed_windows();
 	pipemenu_del_beyond(menu.current_node);
 	recalc_expanded_nodes();
 }
@@ -1346,6 +1962,7 @@ static void del_beyond_current(void)
 static void del_beyond_root(void)
 {
 	ui_win_del_beyond(0);
+	forget_closed_windows();
 	geo_set_cur(0);
 	checkout_rootnode();	/* original root node */
 	pipemenu_del_all();
@@ -1374,10 +1991,10 @@ static void destroy_master_list_from(struct item *from)
 
 	i = from;
 	list_for_each_entry_safe_from(i, i_tmp, &menu.master, master) {
-		xfree(i->buf);
 		list_del(&i->master);
-		xfree(i);
+		destroy_item(i);
 	}
+	drawn.valid = 0;
 }
 
 static void pipemenu_add(const char *s)
@@ -1386,9 +2003,10 @@ static void pipemenu_add(const char *s)
 	struct item *pipe_head;
 	struct node *parent_node;
 	int nr_lines;
+	pid_t pid;
 
 	BUG_ON(!s);
-	fp = popen(s, "r");
+	fp = spawn_popen(s, &pid);
 	if (!fp) {
 		warn("could not open pipe '%s'", s);
 		return;
@@ -1396,8 +2014,7 @@ static void pipemenu_add(const char *s)
 
 	pipe_head = list_last_entry(&menu.master, struct item, master);
 	nr_lines = read_csv_file(fp, true);
-	if (fp && fp != stdin)
-		pclose(fp);
+	spawn_pclose(fp, pid);
 	if (!nr_lines) {
 		warn("empty pipemenu");
 		return;
@@ -1480,23 +2097,6 @@ static void checkout_parent(void)
 		set_submenu_height();
 }
 
-static void clear_self_pipe(void)
-{
-	fd_set readfds;
-
-	if (!FD_ISSET(pipe_fds[0], &readfds))
-		return;
-	for (;;) {
-		char ch;
-
-		if (read(pipe_fds[0], &ch, 1) == -1) {
-			if (errno == EAGAIN)
-				break;
-			warn("error reading pipe");
-		}
-	}
-}
-
 static void hide_menu(void)
 {
 	tmr_mouseover_stop();
@@ -1508,7 +2108,6 @@ static void hide_menu(void)
 	menu.current_node->expanded = NULL;
 	menu.sel = NULL;
 	update(1);
-	clear_self_pipe();
 	menu_is_hidden = 1;
 }
 
@@ -1602,30 +2201,55 @@ static void action_cmd(char *cmd, const char *working_dir)
 	}
 }
 
-static struct point mousexy(void)
+/* Key strokes which only add to or remove from the filter needle */
+static int is_filter_input(KeySym ksym, const char *buf, int len)
 {
-	Window dw;
-	int di;
-	unsigned int du;
-	struct point coords;
-
-	XQueryPointer(ui->dpy, ui->w[ui->cur].win, &dw, &dw, &di, &di, &coords.x,
-		      &coords.y, &du);
-
-	return coords;
+	if (ksym == XK_BackSpace)
+		return filter_needle_length();
+	return len > 0 && (unsigned char)buf[0] >= 0x20 && buf[0] != 0x7f;
 }
 
-static void key_event(XKeyEvent *ev)
+/* Key strokes which only move the selection within the current window */
+static int is_navigation_key(KeySym ksym)
 {
-	char buf[32];
-	int len;
-	KeySym ksym = NoSymbol;
-	Status status;
-	int isoutside;
-
-	len = Xutf8LookupString(ui->w[ui->cur].xic, ev, buf, sizeof(buf), &ksym, &status);
+	switch (ksym) {
+	case XK_Up:
+	case XK_Down:
+		return !widgets_get_kb_grabbed();
+	case XK_Home:
+	case XK_End:
+	case XK_Prior:
+	case XK_Next:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static void key_event(XKeyEvent *ev)
+{
+	char buf[32];
+	int len;
+	KeySym ksym = NoSymbol;
+	Status status;
+	int isoutside;
+
+	len = Xutf8LookupString(ui->w[ui->cur].xic, ev, buf, sizeof(buf), &ksym, &status);
 	if (status == XBufferOverflow)
 		return;
+
+	/*
+	 * Filter input and navigation are coalesced with any following key
+	 * strokes. Anything else may open or close windows, so we bring the
+	 * current window up-to-date first.
+	 */
+	if (is_filter_input(ksym, buf, len))
+		;
+	else if (is_navigation_key(ksym))
+		apply_pending_filter();
+	else
+		flush_pending();
+
 	if (ui_has_child_window_open(menu.current_node->wid))
 		del_beyond_current();
 
@@ -1645,7 +2269,7 @@ static void key_event(XKeyEvent *ev)
 		menu.sel = last_selectable();
 		init_menuitem_coordinates();
 		menu.current_node->last_sel = menu.sel;
-		draw_menu();
+		schedule_draw_selection();
 		break;
 	case XK_Super_L:
 	case XK_Super_R:
@@ -1654,7 +2278,7 @@ static void key_event(XKeyEvent *ev)
 	case XK_Escape:
 		if (filter_needle_length()) {
 			filter_reset();
-			update(0);
+			schedule_update();
 		} else {
 			hide_or_exit();
 		}
@@ -1667,7 +2291,7 @@ static void key_event(XKeyEvent *ev)
 		menu.sel = first_selectable();
 		init_menuitem_coordinates();
 		menu.current_node->last_sel = menu.sel;
-		draw_menu();
+		schedule_draw_selection();
 		break;
 	case XK_Up:
 		if (widgets_get_kb_grabbed()) {
@@ -1692,7 +2316,7 @@ static void key_event(XKeyEvent *ev)
 		}
 		init_menuitem_coordinates();
 		menu.current_node->last_sel = menu.sel;
-		draw_menu();
+		schedule_draw_selection();
 		break;
 	case XK_Next:	/* PageDown */
 		if (filter_head() == &empty_item)
@@ -1708,7 +2332,7 @@ static void key_event(XKeyEvent *ev)
 		if (!menu.last->selectable)
 			menu.sel = prev_selectable(menu.last, &isoutside);
 		menu.current_node->last_sel = menu.sel;
-		draw_menu();
+		schedule_draw_selection();
 		break;
 	case XK_Prior:	/* PageUp */
 		if (filter_head() == &empty_item)
@@ -1724,7 +2348,7 @@ static void key_event(XKeyEvent *ev)
 		if (!menu.sel->selectable)
 			menu.sel = next_selectable(menu.first, &isoutside);
 		menu.current_node->last_sel = menu.sel;
-		draw_menu();
+		schedule_draw_selection();
 		break;
 	case XK_Return:
 	case XK_KP_Enter:
@@ -1753,7 +2377,7 @@ static void key_event(XKeyEvent *ev)
 		}
 		init_menuitem_coordinates();
 		menu.current_node->last_sel = menu.sel;
-		draw_menu();
+		schedule_draw_selection();
 		break;
 	case XK_Left:
 		if (!menu.current_node->parent)
@@ -1786,7 +2410,7 @@ static void key_event(XKeyEvent *ev)
 	case XK_BackSpace:
 		if (filter_needle_length()) {
 			filter_backspace();
-			update(0);
+			schedule_update();
 		} else {
 			checkout_parent();
 			update(1);
@@ -1796,7 +2420,7 @@ static void key_event(XKeyEvent *ev)
 		if (filter_get_clear_on_keyboard_input())
 			filter_reset();
 		filter_addstr(buf, len);
-		update(0);
+		schedule_update();
 		break;
 	}
 }
@@ -1836,7 +2460,7 @@ static void mouse_release(XEvent *e)
 		step_back(&menu.sel, 1);
 		init_menuitem_coordinates();
 		menu.current_node->last_sel = menu.sel;
-		draw_menu();
+		schedule_draw_selection();
 		return;
 	}
 
@@ -1851,7 +2475,7 @@ static void mouse_release(XEvent *e)
 		step_fwd(&menu.sel, 1);
 		init_menuitem_coordinates();
 		menu.current_node->last_sel = menu.sel;
-		draw_menu();
+		schedule_draw_selection();
 		return;
 	}
 
@@ -1923,6 +2547,8 @@ static void *load_icons(void *arg)
 	clock_gettime(CLOCK_MONOTONIC, &ts_start);
 	icon_load();
 	clock_gettime(CLOCK_MONOTONIC, &ts_end);
+	prof_add(PROF_ICONS, "icon_load", timespec_to_sec(&ts_start),
+		 timespec_to_sec(&ts_end));
 	if (DEBUG_ICONS_LOADED_NOTIFICATION) {
 		duration = timespec_to_sec(&ts_end) - timespec_to_sec(&ts_start);
 		fprintf(stderr, "Icons loaded in %f seconds\n", duration);
@@ -1939,10 +2565,10 @@ static void destroy_master_list(void)
 	struct item *item, *tmp_item;
 
 	list_for_each_entry_safe(item, tmp_item, &menu.master, master) {
-		xfree(item->buf);
 		list_del(&item->master);
-		xfree(item);
+		destroy_item(item);
 	}
+	drawn.valid = 0;
 }
 
 static void init_pipe_flags(void)
@@ -1976,7 +2602,7 @@ static void move_selection_with_mouse(struct point *mouse_coord)
 			if (menu.sel != item) {
 				menu.sel = item;
 				menu.current_node->last_sel = item;
-				draw_menu();
+				schedule_draw_selection();
 			}
 			return;
 		}
@@ -1987,56 +2613,20 @@ static void move_selection_with_mouse(struct point *mouse_coord)
 
 	if (!menu.current_node->expanded && menu.sel) {
 		menu.sel = NULL;
-		draw_menu();
+		schedule_draw_selection();
 	}
 	if (widgets_mouseover())
-		draw_menu();
-}
-
-static void mouseover_handler(int sig)
-{
-	int saved_errno;
-
-	saved_errno = errno;
-	if (write(pipe_fds[1], "t", 1) == -1)
-		die("error writing to pipe for onmouseover timer");
-	errno = saved_errno;
-}
-
-static void tmr_mouseover_init(void)
-{
-	if (signal(SIGALRM, (void *)mouseover_handler) == SIG_ERR)
-		die("SIGALRM action");
-}
-
-static void tmr_mouseover_set(int msec)
-{
-	struct itimerval it;
-	static int run_once;
-
-	if (msec >= 1000)
-		msec = 999;
-	if (!run_once) {
-		tmr_mouseover_init();
-		run_once = 1;
-	}
-	it.it_value.tv_sec = 0;
-	it.it_value.tv_usec = msec * 1000;
-	it.it_interval.tv_sec = 0;
-	it.it_interval.tv_usec = 0;
-	/* As timer_*() are not supported on OpenBSD, we use setitimer() */
-	if (setitimer(ITIMER_REAL, &it, NULL) == -1)
-		die("setitimer()");
+		schedule_draw();
 }
 
 static void tmr_mouseover_start(void)
 {
-	tmr_mouseover_set(config.hover_delay);
+	loop_timer_start(mouseover_timer, config.hover_delay);
 }
 
 static void tmr_mouseover_stop(void)
 {
-	tmr_mouseover_set(0);
+	loop_timer_stop(mouseover_timer);
 }
 
 static struct node *get_node_from_wid(Window w)
@@ -2128,12 +2718,9 @@ static void process_pointer_position(XEvent *ev, int force)
 	static int oldx;
 	XMotionEvent *e = (XMotionEvent *)ev;
 
-	/*
-	 * We get the mouse coordinates using XQueryPointer() as
-	 * ev.xbutton.{x,y} sometimes returns peculiar values.
-	 * If we ever need the coordinates relative to the root window, use
-	 * e->x_root and e->y_root
-	 */
+	apply_pending_filter();
+
+	pointer_track(ev);
 	pw = mousexy();
 	pw.y -= MOUSE_FUDGE;
 	if (!force && (pw.x == oldx) && (pw.y == oldy))
@@ -2165,46 +2752,301 @@ static void process_pointer_position(XEvent *ev, int force)
 	oldy = pw.y;
 }
 
-static void signal_handler(int sig)
+static void show_menu(void)
 {
-	int saved_errno;
+	if (menu_is_hidden)
+		awake_menu();
+}
 
-	saved_errno = errno;
-	if (write(pipe_fds[1], "1", 1) == -1 && errno != EAGAIN)
-		die("write");
-	errno = saved_errno;
+/* Run a command received on the control socket (see ipc.c) */
+static void ipc_cmd(char *cmd, struct sbuf *reply)
+{
+	struct sbuf s;
+	char *arg;
+
+	arg = strchr(cmd, ' ');
+	if (arg)
+		*arg++ = '\0';
+	if (!strcmp(cmd, "show")) {
+		show_menu();
+	} else if (!strcmp(cmd, "hide")) {
+		if (!menu_is_hidden)
+			hide_menu();
+	} else if (!strcmp(cmd, "toggle")) {
+		if (menu_is_hidden)
+			awake_menu();
+		else
+			hide_menu();
+	} else if (!strcmp(cmd, "checkout") && arg) {
+		show_menu();
+		sbuf_init(&s);
+		sbuf_addstr(&s, "^root(");
+		sbuf_addstr(&s, strstrip(arg));
+		sbuf_addstr(&s, ")");
+		action_cmd(s.buf, NULL);
+		xfree(s.buf);
+	} else if (!strcmp(cmd, "filter") && arg) {
+		show_menu();
+		sbuf_init(&s);
+		sbuf_addstr(&s, "^filter(");
+		sbuf_addstr(&s, arg);
+		sbuf_addstr(&s, ")");
+		action_cmd(s.buf, NULL);
+		xfree(s.buf);
+	} else if (!strcmp(cmd, "reload")) {
+		restart();
+	} else if (!strcmp(cmd, "stats")) {
+		if (!config.icon_size)
+			sbuf_addstr(reply, "icons: disabled\n");
+		else if (!all_icons_loaded)
+			sbuf_addstr(reply, "icons: loading\n");
+		else
+			icon_stats(reply);
+	} else {
+		warn("ipc: unknown command '%s'", cmd);
+	}
 }
 
-static void run(void)
+static void handle_x_event(XEvent *ev)
+{
+	static int close_pending;
+
+	pointer_track(ev);
+	switch (ev->type) {
+	case MappingNotify:
+		XRefreshKeyboardMapping(&ev->xmapping);
+		break;
+	case ButtonRelease:
+		if (close_pending) {
+			close_pending = 0;
+			hide_or_exit();
+			break;
+		}
+		mouse_release(ev);
+		break;
+	case ButtonPress:
+		/*
+		 * tint2 buttons/execps take action on "ButtonRelease". We want
+		 * to be able to use these to both open and close the menu.
+		 * When passing mouse events through tint2 to the WM, we want
+		 * menu to be able to repsond to "ButtonPress" without
+		 * immediately dying on "ButtonRelease".
+		 */
+		if (mouse_outside(ev))
+			close_pending = 1;
+		break;
+	case KeyRelease:
+		if (super_key_pressed) {
+			super_key_pressed = 0;
+			/* avoid passing super key to WM */
+			msleep(30);
+			hide_or_exit();
+		}
+		break;
+	case KeyPress:
+		key_event(&ev->xkey);
+		break;
+	case Expose:
+		if (ev->xexpose.count == 0)
+			ui_map_window(geo_get_menu_width(),
+				      geo_get_menu_height());
+		break;
+	case VisibilityNotify:
+		if (ev->xvisibility.state != VisibilityUnobscured)
+			XRaiseWindow(ui->dpy, ui->w[ui->cur].win);
+		break;
+	case MotionNotify:
+		process_pointer_position(ev, 0);
+		break;
+	}
+}
+
+/*
+ * Drain the X event queue before re-filtering and painting, so that bursts
+ * of key strokes and pointer movement cost one frame rather than one per
+ * event. Consecutive MotionNotify events are collapsed to the last one.
+ * On return, @ev holds the last event processed.
+ */
+static void process_x_events(XEvent *ev)
+{
+	XEvent motion;
+	int motion_pending = 0;
+
+	while (XPending(ui->dpy)) {
+		XNextEvent(ui->dpy, ev);
+
+		/* UTF-8 support */
+		if (XFilterEvent(ev, ui->w[ui->cur].win))
+			continue;
+
+		if (ev->type == MotionNotify) {
+			motion = *ev;
+			motion_pending = 1;
+			continue;
+		}
+		if (motion_pending) {
+			process_pointer_position(&motion, 0);
+			motion_pending = 0;
+		}
+		/* Only key strokes can be applied to out-of-date menu state */
+		if (ev->type != KeyPress)
+			flush_pending();
+		handle_x_event(ev);
+	}
+	if (motion_pending) {
+		*ev = motion;
+		process_pointer_position(ev, 0);
+	}
+}
+
+/* mouse over signal */
+static void mouseover_expired(void *data)
+{
+	BUG_ON(!menu.sel);
+	del_beyond_current();
+	/* open new sub window */
+	if (!sw_close_pending && !menu_is_hidden) {
+		menu.current_node->expanded = menu.sel;
+		action_cmd(menu.sel->cmd, menu.sel->working_dir);
+	}
+	sw_close_pending = 0;
+	process_pointer_position(&last_event, 1);
+}
+
+static void sigusr1_caught(int signum)
+{
+	awake_menu();
+}
+
+/* Restart a hidden menu in the background when its sources have changed */
+static void watch_ready(int fd, void *data)
+{
+	watch_process();
+	if ((watch_changes() & watch_mask) && menu_is_hidden)
+		loop_timer_start(restart_timer, RESTART_DELAY_MS);
+}
+
+static void restart_expired(void *data)
+{
+	/* if the menu has been shown since, awake_menu() has dealt with it */
+	if (menu_is_hidden)
+		restart_hidden();
+}
+
+static void ipc_ready(int fd, void *data)
+{
+	ipc_read_socket(ipc_cmd);
+}
+
+/* The icon and render threads write to the self-pipe when they are done */
+static void self_pipe_ready(int fd, void *data)
 {
-	XEvent ev;
 	struct item *item;
+	char ch;
+	double t;
+
+	for (;;) {
+		if (read(fd, &ch, 1) == -1) {
+			if (errno == EAGAIN)
+				break;
+			die("error reading pipe");
+		}
+
+		/* a frame has been rendered on the render thread */
+		if (ch == 'r') {
+			t = prof_now();
+			if (!render_thread_present(frame_seq, paint_frame) ||
+			    profile_frame != 1)
+				continue;
+			profile_frame++;
+			prof_add(PROF_MAIN, "first present", t, prof_now());
+			if (!--profile_waiting)
+				prof_report();
+			continue;
+		}
+
+		/* 'x' means that icons have finished loading */
+		if (ch != 'x')
+			continue;
+
+		/* for performance testing */
+		if (args_die_when_loaded() && all_icons_have_been_requested)
+			exit(0);
+
+		if (DEBUG_ICONS_LOADED_NOTIFICATION &&
+		    all_icons_have_been_requested)
+			fprintf(stderr, "All icons loaded\n");
+
+		if (DEBUG_ICONS_LOADED_NOTIFICATION &&
+		    !all_icons_have_been_requested)
+			fprintf(stderr, "Root menu icons loaded\n");
+
+		pthread_join(thread, NULL);
+		all_icons_loaded = all_icons_have_been_requested;
+		/*
+		 * The render thread cannot use server-side icons. Uploading
+		 * icons mapped from the pack trades their shared pages for
+		 * draws without client-to-server copies (see jgmenu(1)).
+		 */
+		if (!config.threaded_rendering)
+			icon_upload(ui->w[ui->cur].cs);
+
+		/* icons which are still loading must not be touched */
+		list_for_each_entry(item, &menu.master, master)
+			if (!item->icon_ref && icon_get_surface(item->iconname))
+				item->icon_ref = icon_get(item->iconname);
+
+		t = prof_now();
+		draw_menu();
+
+		if (all_icons_have_been_requested)
+			continue;
 
-	int ready, nfds, x11_fd;
-	fd_set readfds;
-	static int all_icons_have_been_requested;
-	struct sigaction sa;
+		prof_add(PROF_MAIN, "draw_menu with icons", t, prof_now());
+		if (!--profile_waiting)
+			prof_report();
+
+		/* Get remaining icons */
+		list_for_each_entry(item, &menu.master, master)
+			if (item->iconname)
+				icon_set_name(item->iconname);
+
+		pthread_create(&thread, NULL, load_icons, NULL);
+		all_icons_have_been_requested = 1;
+	}
+}
+
+static void run(void)
+{
+	struct item *item;
+	int fd;
 
 	/* for performance testing */
 	if (args_die_when_loaded() && !config.icon_size)
 		exit(0);
 
-	FD_ZERO(&readfds);
-	nfds = 0;
-
-	/* Set x11 fd */
-	x11_fd = ConnectionNumber(ui->dpy);
-	nfds = MAX(nfds, x11_fd + 1);
-	FD_SET(x11_fd, &readfds);
+	/* X events are read with XPending() below */
+	loop_add_fd(ConnectionNumber(ui->dpy), NULL, NULL);
 
 	/* Create icon pipe */
 	if (pipe(pipe_fds) == -1)
 		die("error creating pipe");
+	init_pipe_flags();
+	loop_add_fd(pipe_fds[0], self_pipe_ready, NULL);
 
-	FD_SET(pipe_fds[0], &readfds);
-	nfds = MAX(nfds, pipe_fds[0] + 1);
+	/* Control socket for jgmenu-socket (and thereby jgmenu_run) */
+	if (config.stay_alive && !ui_is_offscreen()) {
+		fd = ipc_init_socket();
+		if (fd != -1)
+			loop_add_fd(fd, ipc_ready, NULL);
+	}
 
-	init_pipe_flags();
+	if (config.stay_alive && watch_fd() != -1) {
+		restart_timer = loop_timer_new(restart_expired, NULL);
+		loop_add_fd(watch_fd(), watch_ready, NULL);
+	}
+
+	pointer_init();
 
 	if (config.icon_size) {
 		/*
@@ -2221,168 +3063,138 @@ static void run(void)
 		pthread_create(&thread, NULL, load_icons, NULL);
 	}
 
-	sigemptyset(&sa.sa_mask);
-	sa.sa_flags = SA_RESTART;
-	sa.sa_handler = signal_handler;
-	if (sigaction(SIGUSR1, &sa, NULL) == -1)
-		die("sigaction");
+	/*
+	 * The profile is complete once icons have loaded and, if the menu is
+	 * then drawn on the render thread, that frame is shown (see draw_menu())
+	 */
+	profile_waiting = !!config.icon_size;
+	if (!profile_waiting)
+		prof_report();
 
 	if (config.hide_on_startup)
 		hide_menu();
 
 	for (;;) {
-		FD_ZERO(&readfds);
-		FD_SET(x11_fd, &readfds);
-		FD_SET(pipe_fds[0], &readfds);
-
 		/*
-		 * XPending() is non-blocking whereas select() is blocking.
-		 *
 		 * Some X events are stored in a queue in memory, so we cannot
-		 * rely on reading ConnectionNumber() alone to catch all events.
+		 * rely on the X connection being readable to catch all events
+		 * and must not block whilst XPending() is non-zero.
 		 */
-		ready = 0;
-		if (!XPending(ui->dpy))
-			ready = select(nfds, &readfds, NULL, NULL, NULL);
+		loop_dispatch(!XPending(ui->dpy));
 
-		if (ready == -1 && errno == EINTR)
-			continue;
+		if (XPending(ui->dpy))
+			process_x_events(&last_event);
+		flush_pending();
+	}
+}
 
-		if (ready == -1)
-			die("select()");
+/*
+ * Offscreen mode (--offscreen=<file>) renders into image surfaces without an
+ * X display, for pixel tests and frame-time benchmarks. <file> contains one
+ * command per line:
+ *   select <n>      select the n-th item of the current menu (counting from 0)
+ *   checkout <tag>  open submenu <tag> as ^checkout(<tag>) would
+ *   root <tag>      replace the root menu with <tag> as ^root(<tag>) would
+ *   render <n>      draw the current menu <n> times and print the time taken
+ *   png <file>      save the current menu as a PNG image
+ * Empty lines and lines beginning with '#' are ignored. Any error is fatal, so
+ * that tests can rely on the exit status.
+ */
+static void offscreen_load_icons(void)
+{
+	struct item *item;
 
-		/*
-		 * Check if there is something in the selfpipe. E.g. the icon
-		 * thread has finished or we have caught a USR1 signal
-		 */
-		if (FD_ISSET(pipe_fds[0], &readfds) && ready) {
-			for (;;) {
-				char ch;
-
-				if (read(pipe_fds[0], &ch, 1) == -1) {
-					if (errno == EAGAIN)
-						break;
-					die("error reading pipe");
-				}
-
-				/* Caught SIGUSR1 */
-				if (ch == '1') {
-					awake_menu();
-					continue;
-				}
-
-				/* mouse over signal */
-				if (ch == 't') {
-					BUG_ON(!menu.sel);
-					del_beyond_current();
-					/* open new sub window */
-					if (!sw_close_pending && !menu_is_hidden) {
-						menu.current_node->expanded = menu.sel;
-						action_cmd(menu.sel->cmd,
-							   menu.sel->working_dir);
-					}
-					sw_close_pending = 0;
-					process_pointer_position(&ev, 1);
-					continue;
-				}
-
-				/* 'x' means that icons have finished loading */
-				if (ch != 'x')
-					continue;
-
-				/* for performance testing */
-				if (args_die_when_loaded() && all_icons_have_been_requested)
-					exit(0);
-
-				if (DEBUG_ICONS_LOADED_NOTIFICATION &&
-				    all_icons_have_been_requested)
-					fprintf(stderr, "All icons loaded\n");
-
-				if (DEBUG_ICONS_LOADED_NOTIFICATION &&
-				    !all_icons_have_been_requested)
-					fprintf(stderr, "Root menu icons loaded\n");
-
-				pthread_join(thread, NULL);
-
-				list_for_each_entry(item, &menu.master, master)
-					if (!item->icon)
-						item->icon = icon_get_surface(item->iconname);
-
-				draw_menu();
-
-				if (all_icons_have_been_requested)
-					continue;
-
-				/* Get remaining icons */
-				list_for_each_entry(item, &menu.master, master)
-					if (item->iconname)
-						icon_set_name(item->iconname);
-
-				pthread_create(&thread, NULL, load_icons, NULL);
-				all_icons_have_been_requested = 1;
-			}
+	if (!config.icon_size)
+		return;
+	list_for_each_entry(item, &menu.master, master)
+		if (item->iconname)
+			icon_set_name(item->iconname);
+	icon_load();
+	list_for_each_entry(item, &menu.master, master)
+		if (!item->icon_ref)
+			item->icon_ref = icon_get(item->iconname);
+}
+
+static void offscreen_select(const char *arg)
+{
+	struct item *p;
+	int n, i = 0;
+
+	xatoi(&n, arg, XATOI_NONNEG, "offscreen: select");
+	list_for_each_entry(p, &menu.filter, filter) {
+		if (i++ != n)
+			continue;
+		menu.sel = p;
+		menu.current_node->last_sel = p;
+		if (!isvisible(p)) {
+			menu.first = p;
+			menu.last = fill_from_top(p);
 		}
+		init_menuitem_coordinates();
+		draw_menu();
+		return;
+	}
+	die("offscreen: there is no item '%d'", n);
+}
 
-		if (XPending(ui->dpy)) {
-			static int close_pending;
+static void offscreen_render(const char *arg)
+{
+	struct timespec ts_start, ts_end;
+	double duration;
+	int n, i;
 
-			XNextEvent(ui->dpy, &ev);
+	xatoi(&n, arg, XATOI_GT_0, "offscreen: render");
+	clock_gettime(CLOCK_MONOTONIC, &ts_start);
+	for (i = 0; i < n; i++)
+		draw_menu();
+	clock_gettime(CLOCK_MONOTONIC, &ts_end);
+	duration = timespec_to_sec(&ts_end) - timespec_to_sec(&ts_start);
+	printf("render: %d frames in %.3fms (%.3fms per frame)\n", n,
+	       duration * 1000.0, duration * 1000.0 / n);
+}
 
-			/* UTF-8 support */
-			if (XFilterEvent(&ev, ui->w[ui->cur].win))
-				continue;
+static void run_offscreen(const char *filename)
+{
+	FILE *fp;
+	char line[1024], *cmd, *arg;
+	struct sbuf s;
 
-			switch (ev.type) {
-			case MappingNotify:
-				XRefreshKeyboardMapping(&ev.xmapping);
-				break;
-			case ButtonRelease:
-				if (close_pending) {
-					close_pending = 0;
-					hide_or_exit();
-					break;
-				}
-				mouse_release(&ev);
-				break;
-			case ButtonPress:
-				/*
-				 * tint2 buttons/execps take action on
-				 * "ButtonRelease". We want to be able to use
-				 * these to both open and close the menu.
-				 * When passing mouse events through tint2 to
-				 * the WM, we want menu to be able to repsond
-				 * to "ButtonPress" without immediately dying
-				 * on "ButtonRelease".
-				 */
-				if (mouse_outside(&ev))
-					close_pending = 1;
-				break;
-			case KeyRelease:
-				if (super_key_pressed) {
-					super_key_pressed = 0;
-					/* avoid passing super key to WM */
-					msleep(30);
-					hide_or_exit();
-				}
-				break;
-			case KeyPress:
-				key_event(&ev.xkey);
-				break;
-			case Expose:
-				if (ev.xexpose.count == 0)
-					ui_map_window(geo_get_menu_width(),
-						      geo_get_menu_height());
-				break;
-			case VisibilityNotify:
-				if (ev.xvisibility.state != VisibilityUnobscured)
-					XRaiseWindow(ui->dpy, ui->w[ui->cur].win);
-				break;
-			case MotionNotify:
-				process_pointer_position(&ev, 0);
-				break;
-			}
+	fp = fopen(filename, "r");
+	if (!fp)
+		die("cannot open '%s'", filename);
+	offscreen_load_icons();
+	draw_menu();
+	sbuf_init(&s);
+	while (fgets(line, sizeof(line), fp)) {
+		cmd = strstrip(line);
+		if (cmd[0] == '\0' || cmd[0] == '#')
+			continue;
+		arg = strchr(cmd, ' ');
+		if (arg) {
+			*arg++ = '\0';
+			arg = strstrip(arg);
+		} else {
+			arg = cmd + strlen(cmd);
+		}
+		if (!strcmp(cmd, "select")) {
+			offscreen_select(arg);
+		} else if (!strcmp(cmd, "checkout") || !strcmp(cmd, "root")) {
+			sbuf_cpy(&s, !strcmp(cmd, "root") ? "^root(" : "^checkout(");
+			sbuf_addstr(&s, arg);
+			sbuf_addstr(&s, ")");
+			action_cmd(s.buf, NULL);
+		} else if (!strcmp(cmd, "render")) {
+			offscreen_render(arg);
+		} else if (!strcmp(cmd, "png")) {
+			if (ui_canvas_write_png(arg, geo_get_menu_width(),
+						geo_get_menu_height()) < 0)
+				die("offscreen: cannot write '%s'", arg);
+		} else {
+			die("offscreen: unknown command '%s'", cmd);
 		}
 	}
+	xfree(s.buf);
+	fclose(fp);
 }
 
 static void init_geo_variables_from_config(void)
@@ -2410,6 +3222,7 @@ static void set_font(void)
 {
 	font_set();
 	info("set font to '%s'", font_get());
+	font_warmup();
 }
 
 static void set_theme(void)
@@ -2488,18 +3301,105 @@ static void init_sigactions(void)
 
 static void cleanup(void)
 {
+	render_thread_cleanup();
+	/* text caches and icons may hold X resources, so free them first */
+	ui_text_cache_free(&arrow_cache[LABEL_NORM]);
+	ui_text_cache_free(&arrow_cache[LABEL_SEL]);
+	delete_empty_item();
+	destroy_node_tree();
+	destroy_master_list();
+	if (config.icon_size)
+		icon_cleanup();
 	ui_cleanup();
 	config_cleanup();
 	filter_cleanup();
+	filter_jobs_cleanup();
 	font_cleanup();
-	if (config.icon_size)
-		icon_cleanup();
 	widgets_cleanup();
 	watch_cleanup();
+	loop_cleanup();
 	t2conf_atexit();
-	delete_empty_item();
-	destroy_node_tree();
-	destroy_master_list();
+}
+
+/*
+ * Menu data is read on a separate thread, so that a slow csv generator runs
+ * in parallel with the initialisation of X, fonts and the icon theme rather
+ * than after it.
+ */
+static struct {
+	pthread_t thread;
+	FILE *fp;
+	int is_pipe;
+	pid_t pid;
+	char *buf;
+	size_t len;
+} csv_input;
+
+static void *csv_input_read(void *arg)
+{
+	size_t alloc = 0, n;
+
+	for (;;) {
+		if (alloc - csv_input.len < BUFSIZ) {
+			alloc = alloc ? alloc * 2 : 4 * BUFSIZ;
+			csv_input.buf = xrealloc(csv_input.buf, alloc);
+		}
+		n = fread(csv_input.buf + csv_input.len, 1,
+			  alloc - csv_input.len, csv_input.fp);
+		if (!n)
+			break;
+		csv_input.len += n;
+	}
+	return NULL;
+}
+
+static void csv_input_start(int vsimple)
+{
+	FILE *fp = NULL;
+
+	if (args_csv_file()) {
+		fp = fopen(args_csv_file(), "r");
+	} else if (args_csv_cmd()) {
+		fp = spawn_popen(args_csv_cmd(), &csv_input.pid);
+		csv_input.is_pipe = 1;
+	} else if (config.csv_cmd && config.csv_cmd[0] != '\0' &&
+		   !args_simple() && !vsimple) {
+		fp = spawn_popen(config.csv_cmd, &csv_input.pid);
+		csv_input.is_pipe = 1;
+	}
+	if (!fp) {
+		fp = stdin;
+		csv_input.is_pipe = 0;
+	}
+	csv_input.fp = fp;
+	if (pthread_create(&csv_input.thread, NULL, csv_input_read, NULL))
+		die("could not create thread to read menu data");
+}
+
+/* Wait for all of the menu data to be read and return it as a stream */
+static FILE *csv_input_finish(void)
+{
+	FILE *fp;
+
+	pthread_join(csv_input.thread, NULL);
+	if (csv_input.is_pipe)
+		spawn_pclose(csv_input.fp, csv_input.pid);
+	else if (csv_input.fp != stdin)
+		fclose(csv_input.fp);
+	if (!csv_input.len)
+		fp = fopen("/dev/null", "r");
+	else
+		fp = fmemopen(csv_input.buf, csv_input.len, "r");
+	if (!fp)
+		die("cannot open menu data");
+	return fp;
+}
+
+static void csv_input_cleanup(void)
+{
+	xfree(csv_input.buf);
+	csv_input.buf = NULL;
+	csv_input.len = 0;
 }
 
 static void keep_menu_height_between_min_and_max(void)
@@ -2519,6 +3419,7 @@ int main(int argc, char *argv[])
 	int arg_vsimple = 0;
 	FILE *fp = NULL;
 
+	prof_start();
 	args_exec_commands(argc, argv);
 	init_locale();
 	restart_init(argc, argv);
@@ -2541,8 +3442,10 @@ int main(int argc, char *argv[])
 			 !strncmp(argv[i], "-h", 2))
 			usage();
 	}
+	prof_phase("init");
 	if (!arg_vsimple)
 		config_read_jgmenurc(arg_config_file);
+	prof_phase("config_read_jgmenurc");
 	if (!config.verbosity)
 		mute_info();
 	args_parse(argc, argv);
@@ -2555,15 +3458,31 @@ int main(int argc, char *argv[])
 	if (config.stay_alive)
 		lockfile_init();
 
+	/* before any threads are created, so that they all block SIGUSR1 */
+	loop_init();
+	loop_add_signal(SIGUSR1, sigusr1_caught);
+	mouseover_timer = loop_timer_new(mouseover_expired, NULL);
+
+	/* start the csv generator now, as it runs whilst we set up X and fonts */
+	config_csv_post_process();
+	csv_input_start(arg_vsimple);
+
 	if_unity_run_hack();
 
 	watch_init();
-	ui_init();
+	prof_phase("lockfile+watch");
+	if (args_offscreen())
+		ui_init_offscreen(OFFSCREEN_WIDTH, OFFSCREEN_HEIGHT);
+	else
+		ui_init();
+	prof_phase("ui_init");
 	geo_init();
 	filter_init();
+	prof_phase("geo_init");
 
 	if (config.tint2_look)
 		read_tint2rc();
+	prof_phase("read_tint2rc");
 
 	/*
 	 * If _NET_WORKAREA is supported by the Window Manager, set
@@ -2573,38 +3492,45 @@ int main(int argc, char *argv[])
 		workarea_set_margin();
 		workarea_set_panel_pos();
 	}
+	prof_phase("workarea");
 
 	/* Parse jgmenurc again to overrule tint2rc and workarea values */
 	if (!arg_vsimple)
 		config_read_jgmenurc(arg_config_file);
 
 	args_parse(argc, argv);
+	if (ui_is_offscreen()) {
+		config.position_mode = POSITION_MODE_FIXED;
+		config.hide_on_startup = 0;
+		config.threaded_rendering = 0;
+	}
 	config_post_process();
 	/* config variables will not be changed after this point */
+	prof_phase("config_read_jgmenurc+config_post_process");
 
 	set_font();
+	prof_phase("set_font");
 	set_theme();
+	prof_phase("set_theme");
 	init_geo_variables_from_config();
 
-	if (config.position_mode == POSITION_MODE_IPC) {
-		ipc_init_socket();
+	if (config.position_mode == POSITION_MODE_IPC)
 		ipc_align_based_on_env_vars();
-	}
 
-	if (args_csv_file())
-		fp = fopen(args_csv_file(), "r");
-	else if (args_csv_cmd())
-		fp = popen(args_csv_cmd(), "r");
-	else if (config.csv_cmd && config.csv_cmd[0] != '\0' &&
-		 !args_simple() && !arg_vsimple)
-		fp = popen(config.csv_cmd, "r");
-	if (!fp)
-		fp = stdin;
+	/* desktop files etc only matter if the menu is generated from them */
+	watch_mask = WATCH_JGMENURC;
+	if (config.tint2_look)
+		watch_mask |= WATCH_TINT2RC;
+	if (csv_input.is_pipe)
+		watch_mask |= WATCH_MENU;
+
+	fp = csv_input_finish();
 	read_csv_file(fp, false);
-	if (fp && fp != stdin)
-		fclose(fp);
+	fclose(fp);
+	csv_input_cleanup();
 	if (config.hide_back_items)
 		rm_back_items();
+	prof_phase("read_csv");
 
 	/*
 	 * read_csv_file() ensures that the first item is a ^tag() one.
@@ -2624,40 +3550,42 @@ int main(int argc, char *argv[])
 	set_submenu_height();
 	set_submenu_width();
 	keep_menu_height_between_min_and_max();
+	prof_phase("build_tree");
 
-	grabkeyboard();
-	grabpointer();
+	if (!ui_is_offscreen()) {
+		grabkeyboard();
+		grabpointer();
+	}
 
 	if (config.position_mode == POSITION_MODE_PTR)
 		launch_menu_at_pointer();
+	prof_phase("grab+position");
 
-	if (config.menu_height_mode == CONFIG_DYNAMIC)
-		/*
-		 * Make canvases the full size of the monitor to allow for
-		 * future changes in menu size on ^root().
-		 */
-		ui_win_init(geo_get_menu_x0(), geo_get_menu_y0(),
-			    geo_get_menu_width(), geo_get_menu_height(),
-			    geo_get_screen_width(), geo_get_screen_height(),
-			    font_get());
-	else
-		/* Make canvas just big enough */
-		ui_win_init(geo_get_menu_x0(), geo_get_menu_y0(),
-			    geo_get_menu_width(), geo_get_menu_height(),
-			    geo_get_menu_width(), geo_get_menu_height(),
-			    font_get());
+	/* The canvas grows if the menu does (see draw_menu()) */
+	ui_win_init(geo_get_menu_x0(), geo_get_menu_y0(), geo_get_menu_width(),
+		    geo_get_menu_height(), font_get());
+	prof_phase("create_window");
 
 	init_empty_item();
 	update_filtered_list();
 	init_menuitem_coordinates();
+	prof_phase("layout");
+	if (ui_is_offscreen()) {
+		atexit(cleanup);
+		menu.current_node->wid = ui->w[ui->cur].win;
+		run_offscreen(args_offscreen());
+		return 0;
+	}
 	if (config.hide_on_startup)
 		info("menu started in 'hidden' mode; show by `jgmenu_run`");
 	else
 		XMapRaised(ui->dpy, ui->w[ui->cur].win);
 	draw_menu();
+	prof_phase("draw_menu");
 
 	atexit(cleanup);
 	menu.current_node->wid = ui->w[ui->cur].win;
+	ui_win_pool_fill(WIN_POOL_PREFILL);
 	run();
 
 	return 0;
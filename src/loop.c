@@ -0,0 +1,448 @@
+/*
+ * loop.c
+ *
+ * Copyright (C) Johan Malm 2019
+ *
+ * The main event loop. File descriptors, signals and timers are waited on
+ * together and their callbacks are run in normal (not signal handler)
+ * context.
+ *
+ * On Linux, this is built on epoll. Signals are read from a signalfd and each
+ * timer has a timerfd of its own, which gives sub-millisecond precision.
+ * Elsewhere (e.g. the BSDs), poll() is used instead. Signals are then caught
+ * with a handler which writes to a self-pipe, and timers are kept as
+ * deadlines from which the poll() timeout is worked out.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#else
+#include <poll.h>
+#endif
+
+#include "loop.h"
+#include "list.h"
+#include "util.h"
+#include "banned.h"
+
+#define SIGNALS_MAX (8)
+
+struct source {
+	int fd;
+	void (*fn)(int fd, void *data);
+	void *data;
+	int removed;		/* freed once the current dispatch is done */
+	struct list_head list;
+};
+
+struct loop_timer {
+	void (*fn)(void *data);
+	void *data;
+#ifdef __linux__
+	int fd;
+#else
+	int armed;
+	double deadline;	/* in ms on CLOCK_MONOTONIC */
+#endif
+	struct list_head list;
+};
+
+static LIST_HEAD(sources);
+static LIST_HEAD(timers);
+
+static struct {
+	int signum;
+	void (*fn)(int signum);
+} signals[SIGNALS_MAX];
+static int nr_signals;
+
+static void run_signal(int signum)
+{
+	int i;
+
+	for (i = 0; i < nr_signals; i++)
+		if (signals[i].signum == signum)
+			signals[i].fn(signum);
+}
+
+static void run_source(struct source *s)
+{
+	if (!s->removed && s->fn)
+		s->fn(s->fd, s->data);
+}
+
+static void free_removed_sources(void)
+{
+	struct source *s, *tmp;
+
+	list_for_each_entry_safe(s, tmp, &sources, list) {
+		if (!s->removed)
+			continue;
+		list_del(&s->list);
+		xfree(s);
+	}
+}
+
+#ifdef __linux__
+
+#define EVENTS_MAX (16)
+
+static int epfd = -1;
+static int sigfd = -1;
+static sigset_t sigmask;
+
+void loop_init(void)
+{
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd == -1)
+		die("epoll_create1");
+	sigemptyset(&sigmask);
+}
+
+static void backend_add_fd(struct source *s)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = s;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, s->fd, &ev) == -1)
+		die("epoll_ctl");
+}
+
+static void backend_remove_fd(int fd)
+{
+	/* fails harmlessly if the caller has already closed @fd */
+	epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+static void signalfd_ready(int fd, void *data)
+{
+	struct signalfd_siginfo info;
+
+	while (read(fd, &info, sizeof(info)) == sizeof(info))
+		run_signal(info.ssi_signo);
+}
+
+static void backend_add_signal(int signum)
+{
+	sigaddset(&sigmask, signum);
+	if (pthread_sigmask(SIG_BLOCK, &sigmask, NULL))
+		die("pthread_sigmask");
+	if (sigfd != -1) {
+		if (signalfd(sigfd, &sigmask, 0) == -1)
+			die("signalfd");
+		return;
+	}
+	sigfd = signalfd(-1, &sigmask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (sigfd == -1)
+		die("signalfd");
+	loop_add_fd(sigfd, signalfd_ready, NULL);
+}
+
+static void timer_ready(int fd, void *data)
+{
+	struct loop_timer *timer = data;
+	uint64_t nr_expirations;
+
+	/* fails with EAGAIN if the timer has been stopped or re-armed since */
+	if (read(fd, &nr_expirations, sizeof(nr_expirations)) != sizeof(nr_expirations))
+		return;
+	timer->fn(timer->data);
+}
+
+static void timer_init(struct loop_timer *timer)
+{
+	timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timer->fd == -1)
+		die("timerfd_create");
+	loop_add_fd(timer->fd, timer_ready, timer);
+}
+
+static void timer_set(struct loop_timer *timer, long long nsec)
+{
+	struct itimerspec it;
+
+	memset(&it, 0, sizeof(it));
+	it.it_value.tv_sec = nsec / 1000000000;
+	it.it_value.tv_nsec = nsec % 1000000000;
+	if (timerfd_settime(timer->fd, 0, &it, NULL) == -1)
+		die("timerfd_settime");
+}
+
+void loop_timer_start(struct loop_timer *timer, double msec)
+{
+	long long nsec = msec * 1000000;
+
+	/* a zero value would disarm the timer */
+	timer_set(timer, nsec > 0 ? nsec : 1);
+}
+
+void loop_timer_stop(struct loop_timer *timer)
+{
+	timer_set(timer, 0);
+}
+
+void loop_dispatch(int block)
+{
+	struct epoll_event events[EVENTS_MAX];
+	int n, i;
+
+	n = epoll_wait(epfd, events, EVENTS_MAX, block ? -1 : 0);
+	if (n == -1 && errno != EINTR)
+		die("epoll_wait");
+	for (i = 0; i < n; i++)
+		run_source(events[i].data.ptr);
+	free_removed_sources();
+}
+
+static void backend_cleanup(void)
+{
+	struct loop_timer *timer;
+
+	list_for_each_entry(timer, &timers, list)
+		close(timer->fd);
+	if (sigfd != -1)
+		close(sigfd);
+	close(epfd);
+	sigfd = -1;
+	epfd = -1;
+}
+
+#else /* !__linux__ */
+
+static int sig_pipe[2] = { -1, -1 };
+static struct pollfd *pollfds;
+static struct source **pollsources;
+static int pollfds_alloc;
+
+static void set_nonblock_cloexec(int fd)
+{
+	int flags;
+
+	flags = fcntl(fd, F_GETFL);
+	if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+		die("error setting pipe flags");
+	if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)
+		die("error setting pipe flags");
+}
+
+static void signal_handler(int signum)
+{
+	int saved_errno;
+	unsigned char ch = signum;
+
+	saved_errno = errno;
+	if (write(sig_pipe[1], &ch, 1) == -1) {
+		/* the pipe is full, so the signal is already pending */
+	}
+	errno = saved_errno;
+}
+
+static void sig_pipe_ready(int fd, void *data)
+{
+	unsigned char ch;
+
+	while (read(fd, &ch, 1) == 1)
+		run_signal(ch);
+}
+
+void loop_init(void)
+{
+	if (pipe(sig_pipe) == -1)
+		die("error creating pipe");
+	set_nonblock_cloexec(sig_pipe[0]);
+	set_nonblock_cloexec(sig_pipe[1]);
+	loop_add_fd(sig_pipe[0], sig_pipe_ready, NULL);
+}
+
+static void backend_add_fd(struct source *s)
+{
+}
+
+static void backend_remove_fd(int fd)
+{
+}
+
+static void backend_add_signal(int signum)
+{
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	sa.sa_handler = signal_handler;
+	if (sigaction(signum, &sa, NULL) == -1)
+		die("sigaction");
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void timer_init(struct loop_timer *timer)
+{
+	timer->armed = 0;
+}
+
+void loop_timer_start(struct loop_timer *timer, double msec)
+{
+	timer->deadline = now_ms() + msec;
+	timer->armed = 1;
+}
+
+void loop_timer_stop(struct loop_timer *timer)
+{
+	timer->armed = 0;
+}
+
+/* Milliseconds until the next timer expires, rounded up, or -1 if none */
+static int poll_timeout(void)
+{
+	struct loop_timer *timer;
+	double now = now_ms(), left;
+	int timeout = -1;
+
+	list_for_each_entry(timer, &timers, list) {
+		if (!timer->armed)
+			continue;
+		left = timer->deadline - now;
+		if (left <= 0)
+			return 0;
+		if (timeout == -1 || (int)left + 1 < timeout)
+			timeout = (int)left + 1;
+	}
+	return timeout;
+}
+
+static void run_expired_timers(void)
+{
+	struct loop_timer *timer;
+	double now = now_ms();
+
+	list_for_each_entry(timer, &timers, list) {
+		if (!timer->armed || timer->deadline > now)
+			continue;
+		timer->armed = 0;
+		timer->fn(timer->data);
+	}
+}
+
+void loop_dispatch(int block)
+{
+	struct source *s;
+	int nr = 0, n, i;
+
+	list_for_each_entry(s, &sources, list) {
+		if (s->removed)
+			continue;
+		if (nr == pollfds_alloc) {
+			pollfds_alloc = pollfds_alloc ? pollfds_alloc * 2 : 16;
+			pollfds = xrealloc(pollfds, pollfds_alloc * sizeof(*pollfds));
+			pollsources = xrealloc(pollsources, pollfds_alloc * sizeof(*pollsources));
+		}
+		pollfds[nr].fd = s->fd;
+		pollfds[nr].events = POLLIN;
+		pollfds[nr].revents = 0;
+		pollsources[nr++] = s;
+	}
+	n = poll(pollfds, nr, block ? poll_timeout() : 0);
+	if (n == -1 && errno != EINTR)
+		die("poll");
+	for (i = 0; n > 0 && i < nr; i++)
+		if (pollfds[i].revents)
+			run_source(pollsources[i]);
+	run_expired_timers();
+	free_removed_sources();
+}
+
+static void backend_cleanup(void)
+{
+	close(sig_pipe[0]);
+	close(sig_pipe[1]);
+	sig_pipe[0] = -1;
+	sig_pipe[1] = -1;
+	xfree(pollfds);
+	xfree(pollsources);
+	pollfds = NULL;
+	pollsources = NULL;
+	pollfds_alloc = 0;
+}
+
+#endif /* __linux__ */
+
+void loop_add_fd(int fd, void (*fn)(int fd, void *data), void *data)
+{
+	struct source *s;
+
+	s = xcalloc(1, sizeof(*s));
+	s->fd = fd;
+	s->fn = fn;
+	s->data = data;
+	list_add_tail(&s->list, &sources);
+	backend_add_fd(s);
+}
+
+void loop_remove_fd(int fd)
+{
+	struct source *s;
+
+	list_for_each_entry(s, &sources, list) {
+		if (s->fd != fd || s->removed)
+			continue;
+		s->removed = 1;
+		backend_remove_fd(fd);
+	}
+}
+
+void loop_add_signal(int signum, void (*fn)(int signum))
+{
+	if (nr_signals == SIGNALS_MAX)
+		die("too many signals in event loop");
+	signals[nr_signals].signum = signum;
+	signals[nr_signals].fn = fn;
+	nr_signals++;
+	backend_add_signal(signum);
+}
+
+struct loop_timer *loop_timer_new(void (*fn)(void *data), void *data)
+{
+	struct loop_timer *timer;
+
+	timer = xcalloc(1, sizeof(*timer));
+	timer->fn = fn;
+	timer->data = data;
+	timer_init(timer);
+	list_add_tail(&timer->list, &timers);
+	return timer;
+}
+
+void loop_cleanup(void)
+{
+	struct source *s;
+	struct loop_timer *timer, *tmp;
+
+	backend_cleanup();
+	list_for_each_entry(s, &sources, list)
+		s->removed = 1;
+	free_removed_sources();
+	list_for_each_entry_safe(timer, tmp, &timers, list) {
+		list_del(&timer->list);
+		xfree(timer);
+	}
+	nr_signals = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+struct loop_timer;
+
+/**
+ * loop_init - create the event loop
+ *
+ * Must be called before any threads are created, as signals added with
+ * loop_add_signal() are blocked in the calling thread and need to be
+ * inherited as blocked by all others.
+ */
+void loop_init(void);
+
+/**
+ * loop_add_fd - call @fn whenever @fd is readable
+ * @fn: callback; may be NULL if loop_dispatch() just needs to return when
+ *      there is something to read on @fd (e.g. the X connection)
+ * @data: passed unchanged to @fn
+ */
+void loop_add_fd(int fd, void (*fn)(int fd, void *data), void *data);
+
+/**
+ * loop_remove_fd - stop watching @fd
+ * It is safe to call this from within any callback.
+ */
+void loop_remove_fd(int fd);
+
+/**
+ * loop_add_signal - call @fn from the event loop when @signum is caught
+ * The callback runs in normal (not signal handler) context.
+ */
+void loop_add_signal(int signum, void (*fn)(int signum));
+
+/**
+ * loop_timer_new - create a one-shot timer which calls @fn when it expires
+ */
+struct loop_timer *loop_timer_new(void (*fn)(void *data), void *data);
+
+/**
+ * loop_timer_start - (re-)arm @timer to expire in @msec milliseconds
+ * Fractions of a millisecond are honoured where the platform allows.
+ */
+void loop_timer_start(struct loop_timer *timer, double msec);
+
+/* loop_timer_stop - disarm @timer; its callback will not be called */
+void loop_timer_stop(struct loop_timer *timer);
+
+/**
+ * loop_dispatch - wait for and run callbacks of ready fds, signals and timers
+ * @block: if 0, just run the callbacks of whatever is ready now
+ *
+ * Returns after one round of callbacks (or when interrupted).
+ */
+void loop_dispatch(int block);
+
+void loop_cleanup(void);
+
+#endif /* LOOP_H */
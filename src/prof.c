@@ -0,0 +1,136 @@
+/*
+ * prof.c
+ *
+ * Copyright (C) Johan Malm 2019
+ *
+ * Time the phases of start-up (--profile), so that we can tell which of
+ * them dominates on a given machine.
+ *
+ * Spans are always recorded, because that is cheap, but only reported if
+ * profiling is enabled. This means that the phases before the command line
+ * has been parsed are included.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "prof.h"
+#include "util.h"
+#include "banned.h"
+
+#define PROF_SPANS_MAX (64)
+
+struct span {
+	enum prof_thread thread;
+	const char *name;
+	double start, end;
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct span spans[PROF_SPANS_MAX];
+static int nr_spans;
+static double t0 = -1.0, last_phase_end;
+static int enabled;
+static const char *trace_filename;
+
+static const char *thread_names[] = { NULL, "main", "icons", "render" };
+
+double prof_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+void prof_start(void)
+{
+	if (t0 >= 0.0)
+		return;
+	t0 = prof_now();
+	last_phase_end = t0;
+}
+
+void prof_enable(const char *trace_file)
+{
+	enabled = 1;
+	trace_filename = trace_file;
+}
+
+int prof_enabled(void)
+{
+	return enabled;
+}
+
+void prof_add(enum prof_thread thread, const char *name, double start, double end)
+{
+	pthread_mutex_lock(&mutex);
+	prof_start();
+	if (nr_spans < PROF_SPANS_MAX) {
+		spans[nr_spans].thread = thread;
+		spans[nr_spans].name = name;
+		spans[nr_spans].start = start;
+		spans[nr_spans].end = end;
+		nr_spans++;
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+void prof_phase(const char *name)
+{
+	double now = prof_now();
+
+	prof_start();
+	prof_add(PROF_MAIN, name, last_phase_end, now);
+	last_phase_end = now;
+}
+
+static void write_trace(void)
+{
+	FILE *fp;
+	int i;
+
+	fp = fopen(trace_filename, "w");
+	if (!fp) {
+		warn("cannot write '%s'", trace_filename);
+		return;
+	}
+	fprintf(fp, "[\n");
+	for (i = 0; i < nr_spans; i++) {
+		fprintf(fp, "  { \"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, ",
+			spans[i].name);
+		fprintf(fp, "\"tid\": %d, \"ts\": %.0f, \"dur\": %.0f }%s\n",
+			spans[i].thread, (spans[i].start - t0) * 1000000.0,
+			(spans[i].end - spans[i].start) * 1000000.0,
+			i < nr_spans - 1 ? "," : "");
+	}
+	fprintf(fp, "]\n");
+	fclose(fp);
+}
+
+void prof_report(void)
+{
+	static int done;
+	double end = 0.0;
+	int i;
+
+	if (!enabled || done)
+		return;
+	done = 1;
+	pthread_mutex_lock(&mutex);
+	fprintf(stderr, "profile:    start(ms)   duration(ms)\n");
+	for (i = 0; i < nr_spans; i++) {
+		fprintf(stderr, "%8s %12.3f %14.3f   %s\n",
+			thread_names[spans[i].thread],
+			(spans[i].start - t0) * 1000.0,
+			(spans[i].end - spans[i].start) * 1000.0, spans[i].name);
+		if (spans[i].end > end)
+			end = spans[i].end;
+	}
+	fprintf(stderr, "total: %.3fms\n", (end - t0) * 1000.0);
+	if (trace_filename)
+		write_trace();
+	pthread_mutex_unlock(&mutex);
+}
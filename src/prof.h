@@ -0,0 +1,34 @@
+#ifndef PROF_H
+#define PROF_H
+
+/* Threads as they appear in the profile */
+enum prof_thread { PROF_MAIN = 1, PROF_ICONS, PROF_RENDER };
+
+/**
+ * prof_enable - print a profile when prof_report() is called
+ * @trace_file: if not NULL, also write a Chrome trace (chrome://tracing)
+ */
+void prof_enable(const char *trace_file);
+
+/* Set time zero (if not already set). Call first thing in main(). */
+void prof_start(void);
+int prof_enabled(void);
+
+double prof_now(void);
+
+/**
+ * prof_add - record a span which ran from @start to @end (see prof_now())
+ * Can be called from any thread.
+ */
+void prof_add(enum prof_thread thread, const char *name, double start, double end);
+
+/**
+ * prof_phase - record a phase of the main thread which ran from the end of
+ * the previous phase (or start-up) until now
+ */
+void prof_phase(const char *name);
+
+/* Print the profile (once) if enabled */
+void prof_report(void);
+
+#endif /* PROF_H */
@@ -0,0 +1,167 @@
+/*
+ * render-thread.c
+ *
+ * Copyright (C) Johan Malm 2019
+ *
+ * Rasterises frames into client-side image buffers on a separate thread, so
+ * that a slow frame does not hold up the processing of input events.
+ *
+ * There are two buffers. The render thread draws into one, whilst the other
+ * holds the last finished frame until the main thread has presented it (or
+ * a newer frame is finished). The main thread only ever reads the finished
+ * buffer with 'mutex' held.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "render-thread.h"
+#include "x11-ui.h"
+#include "util.h"
+#include "prof.h"
+#include "banned.h"
+
+struct buffer {
+	cairo_surface_t *cs;
+	cairo_t *c;
+	PangoLayout *layout;
+	int w, h;
+	unsigned int seq;
+};
+
+static pthread_t thread;
+static int running;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+/* Protected by 'mutex' */
+static void *next_frame;
+static unsigned int next_seq;
+static int next_w, next_h;
+static struct buffer buffers[2];
+static int ready = -1;		/* index of finished buffer */
+static int quit;
+
+static void (*render_fn)(void *frame);
+static void (*destroy_fn)(void *frame);
+static PangoFontDescription *font;
+static int notify_fd;
+
+static void buffer_free(struct buffer *b)
+{
+	if (!b->cs)
+		return;
+	g_object_unref(b->layout);
+	cairo_destroy(b->c);
+	cairo_surface_destroy(b->cs);
+	b->cs = NULL;
+}
+
+static void buffer_resize(struct buffer *b, int w, int h)
+{
+	if (b->cs && b->w == w && b->h == h)
+		return;
+	buffer_free(b);
+	b->cs = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+	b->c = cairo_create(b->cs);
+	b->layout = pango_cairo_create_layout(b->c);
+	b->w = w;
+	b->h = h;
+}
+
+static void *render_thread(void *arg)
+{
+	struct buffer *b;
+	void *frame;
+	unsigned int seq;
+	double t;
+
+	pthread_mutex_lock(&mutex);
+	for (;;) {
+		while (!quit && !next_frame)
+			pthread_cond_wait(&cond, &mutex);
+		if (quit)
+			break;
+		frame = next_frame;
+		seq = next_seq;
+		next_frame = NULL;
+		b = &buffers[ready == 0 ? 1 : 0];
+		buffer_resize(b, next_w, next_h);
+		pthread_mutex_unlock(&mutex);
+
+		t = prof_now();
+		ui_draw_target_set(b->c, b->layout, font);
+		render_fn(frame);
+		cairo_surface_flush(b->cs);
+		destroy_fn(frame);
+		prof_add(PROF_RENDER, "render", t, prof_now());
+
+		pthread_mutex_lock(&mutex);
+		b->seq = seq;
+		ready = b - buffers;
+		if (write(notify_fd, "r", 1) == -1)
+			warn("could not notify main thread of frame");
+	}
+	pthread_mutex_unlock(&mutex);
+	ui_tile_cache_cleanup();
+	return NULL;
+}
+
+void render_thread_init(void (*render)(void *frame), void (*destroy)(void *frame),
+			const char *fontdesc, int fd)
+{
+	if (running)
+		return;
+	render_fn = render;
+	destroy_fn = destroy;
+	font = pango_font_description_from_string(fontdesc);
+	notify_fd = fd;
+	if (pthread_create(&thread, NULL, render_thread, NULL))
+		die("could not create render thread");
+	running = 1;
+}
+
+void render_thread_submit(void *frame, unsigned int seq, int w, int h)
+{
+	pthread_mutex_lock(&mutex);
+	if (next_frame)
+		destroy_fn(next_frame);
+	next_frame = frame;
+	next_seq = seq;
+	next_w = w;
+	next_h = h;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mutex);
+}
+
+int render_thread_present(unsigned int seq, void (*paint)(cairo_surface_t *image))
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&mutex);
+	if (ready >= 0 && buffers[ready].seq == seq) {
+		paint(buffers[ready].cs);
+		ret = 1;
+	}
+	pthread_mutex_unlock(&mutex);
+	return ret;
+}
+
+void render_thread_cleanup(void)
+{
+	if (!running)
+		return;
+	pthread_mutex_lock(&mutex);
+	quit = 1;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mutex);
+	pthread_join(thread, NULL);
+	running = 0;
+	if (next_frame)
+		destroy_fn(next_frame);
+	next_frame = NULL;
+	buffer_free(&buffers[0]);
+	buffer_free(&buffers[1]);
+	pango_font_description_free(font);
+}
@@ -0,0 +1,39 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include <cairo.h>
+
+/**
+ * render_thread_init - start the render thread
+ * @render: draws @frame using the ui_* drawing functions; must not access
+ *          anything but @frame and read-only data such as config
+ * @destroy: frees a frame
+ * @font: pango font description string
+ * @notify_fd: a 'r' is written here each time a frame is ready
+ */
+void render_thread_init(void (*render)(void *frame), void (*destroy)(void *frame),
+			const char *font, int notify_fd);
+
+/**
+ * render_thread_submit - queue a frame for rendering
+ * @frame: frame to render; ownership passes to the render thread
+ * @seq: sequence number of the frame
+ * @w, @h: size of the frame
+ *
+ * A frame which is still waiting to be rendered is dropped in favour of the
+ * new one.
+ */
+void render_thread_submit(void *frame, unsigned int seq, int w, int h);
+
+/**
+ * render_thread_present - pass the last rendered frame to @paint if it has
+ * sequence number @seq
+ *
+ * Returns 1 if the frame was passed on, and 0 if it was stale or there is
+ * no finished frame.
+ */
+int render_thread_present(unsigned int seq, void (*paint)(cairo_surface_t *image));
+
+void render_thread_cleanup(void);
+
+#endif /* RENDER_THREAD_H */
@@ -8,7 +8,8 @@
 
 #define JGMENU_MAX_ARGS (32)
 
-static char *args[JGMENU_MAX_ARGS];
+/* room for --hide-on-startup and NULL */
+static char *args[JGMENU_MAX_ARGS + 2];
 
 void restart_init(int argc, char **argv)
 {
@@ -28,3 +29,16 @@ void restart(void)
 	if (execvp(args[0], args) < 0)
 		fprintf(stderr, "warn: restart failed\n");
 }
+
+void restart_hidden(void)
+{
+	int i;
+
+	for (i = 0; args[i]; i++)
+		;
+	args[i] = "--hide-on-startup";
+	args[i + 1] = NULL;
+	restart();
+	/* we are still here, so later restarts must not be hidden */
+	args[i] = NULL;
+}
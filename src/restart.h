@@ -4,4 +4,7 @@
 void restart_init(int argc, char **argv);
 void restart(void);
 
+/* restart_hidden - restart with the menu hidden (--hide-on-startup) */
+void restart_hidden(void);
+
 #endif /* RESTART_H */
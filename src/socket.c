@@ -1,29 +1,40 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/un.h>
 
 #include "socket.h"
 #include "banned.h"
 
 /*
- * Add UID to path to support multi-user system
- * Allow for 32-bit UID (i.e. 10 digits)
+ * The socket lives in $XDG_RUNTIME_DIR, which only the user can write to.
+ * Without it, we fall back to /tmp and add the UID to the path to support
+ * multi-user systems. As anyone can create files in /tmp, jgmenu-socket
+ * checks that the socket belongs to the user before connecting to it.
  */
-#define SOCKET_PATH_LEN (40)
+#define SOCKET_PATH_LEN (sizeof(((struct sockaddr_un *)0)->sun_path))
 static char socket_path[SOCKET_PATH_LEN];
 
 static void socket_init(void)
 {
 	static int done;
+	const char *runtime_dir;
+	int n = -1;
 
 	if (done)
 		return;
-	snprintf(socket_path, SOCKET_PATH_LEN, "/tmp/jgmenu_unix_socket_%d",
-		 getuid());
+	runtime_dir = getenv("XDG_RUNTIME_DIR");
+	if (runtime_dir && runtime_dir[0] == '/')
+		n = snprintf(socket_path, SOCKET_PATH_LEN, "%s/jgmenu_unix_socket",
+			     runtime_dir);
+	if (n < 0 || (size_t)n >= SOCKET_PATH_LEN)
+		snprintf(socket_path, SOCKET_PATH_LEN,
+			 "/tmp/jgmenu_unix_socket_%d", getuid());
 	done = 1;
 }
 
-char *tint2_socket_path(void)
+char *jgmenu_socket_path(void)
 {
 	socket_init();
 	return socket_path;
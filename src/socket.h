@@ -3,6 +3,7 @@
 
 #define SOCKET_BUF_SIZE 4096
 
-char *tint2_socket_path(void);
+/* The control socket of a running jgmenu (see ipc.c) */
+char *jgmenu_socket_path(void);
 
 #endif
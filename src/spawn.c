@@ -1,3 +1,16 @@
+/*
+ * spawn.c
+ *
+ * Menu items are launched with vfork(), so that the time it takes does not
+ * grow with the size of jgmenu (which can be large once icons are loaded).
+ * Simple commands (a program followed by arguments, without anything the
+ * shell would interpret) are exec'd directly after a cached $PATH lookup.
+ * Anything else is run with '$SHELL -c'.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <signal.h>
 #include <sys/wait.h>
 #include <stdlib.h>
@@ -5,10 +18,16 @@
 #include <stdio.h>
 
 #include "spawn.h"
+#include "isprog.h"
 #include "util.h"
 #include "sbuf.h"
 #include "banned.h"
 
+extern char **environ;
+
+/* Characters which make us leave a command to the shell */
+static const char shell_chars[] = "|&;<>()$`\\\"'*?[]{}#~!\n";
+
 /* voids zombie processes */
 static void set_no_child_wait(void)
 {
@@ -24,23 +43,96 @@ static void set_no_child_wait(void)
 	done = 1;
 }
 
-static void resolve_and_chdir(const char *working_dir)
+/* jgmenu blocks signals which it reads from its event loop (see loop.c) */
+static void unblock_signals(void)
+{
+	sigset_t set;
+
+	sigemptyset(&set);
+	sigprocmask(SIG_SETMASK, &set, NULL);
+}
+
+static void resolve_working_dir(struct sbuf *dir, const char *working_dir)
+{
+	const char *home;
+
+	if (working_dir && working_dir[0] != '\0') {
+		sbuf_cpy(dir, working_dir);
+		sbuf_expand_tilde(dir);
+		sbuf_expand_env_var(dir);
+	} else {
+		home = getenv("HOME");
+		if (home)
+			sbuf_cpy(dir, home);
+	}
+	/* the child cannot safely print warnings after vfork() */
+	if (!dir->len || access(dir->buf, X_OK) < 0)
+		warn("cannot chdir into '%s'", dir->len ? dir->buf : "$HOME");
+}
+
+int spawn_split_command(char *buf, char **argv)
 {
-	struct sbuf s;
-
-	sbuf_init(&s);
-	sbuf_cpy(&s, working_dir);
-	sbuf_expand_tilde(&s);
-	sbuf_expand_env_var(&s);
-	if (chdir(s.buf) < 0)
-		warn("cannot chdir into '%s'", s.buf);
-	xfree(s.buf);
+	int argc = 0;
+	char *p = buf;
+
+	if (buf[strcspn(buf, shell_chars)] != '\0')
+		return 0;
+	for (;;) {
+		p += strspn(p, " \t");
+		if (*p == '\0')
+			break;
+		if (argc == SPAWN_ARGS_MAX)
+			return 0;
+		argv[argc++] = p;
+		p += strcspn(p, " \t");
+		if (*p != '\0')
+			*p++ = '\0';
+	}
+	argv[argc] = NULL;
+	/* variable assignments, as in 'FOO=bar cmd' */
+	if (!argc || strchr(argv[0], '='))
+		return 0;
+	return argc;
+}
+
+/*
+ * Run @prog with @argv in a new session in @dir, or '@shell -c @arg' if @prog
+ * is NULL or cannot be run. Everything the child needs is prepared by the
+ * caller, as it shares our memory until it calls exec and so must only call
+ * async-signal-safe functions.
+ */
+static pid_t vfork_exec(const char *prog, char **argv, const char *shell,
+			const char *arg, const char *dir)
+{
+	sigset_t all, old;
+	pid_t pid;
+
+	/* the child must not run our signal handlers */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	pid = vfork();
+	if (pid == 0) {
+		setsid();
+		if (dir && chdir(dir) < 0) {
+			/* warned about by resolve_working_dir() */
+		}
+		unblock_signals();
+		if (prog)
+			execve(prog, argv, environ);
+		/* if the program has gone since it was looked up, try the shell */
+		execl(shell, shell, "-c", arg, (char *)NULL);
+		_exit(127);
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	return pid;
 }
 
 void spawn(const char *arg, const char *working_dir)
 {
 	const char default_shell[] = "/bin/sh";
-	const char *shell = NULL;
+	const char *shell = NULL, *prog = NULL;
+	char *argv[SPAWN_ARGS_MAX + 1];
+	struct sbuf buf, dir;
 
 	if (!arg)
 		return;
@@ -48,23 +140,59 @@ void spawn(const char *arg, const char *working_dir)
 	shell = getenv("SHELL");
 	if (!shell)
 		shell = default_shell;
-	switch (fork()) {
-	case -1:
-		die("unable to fork()");
-		break;
-	case 0:
-		setsid();
-		if (working_dir && working_dir[0] != '\0') {
-			resolve_and_chdir(working_dir);
-		} else {
-			if (chdir(getenv("HOME")) < 0)
-				warn("cannot chdir into $HOME");
-		}
-		execl(shell, shell, "-c", arg, (char *)NULL);
-		exit(0);
-	default:
-		break;
+	sbuf_init(&buf);
+	sbuf_cpy(&buf, arg);
+	if (spawn_split_command(buf.buf, argv))
+		prog = strchr(argv[0], '/') ? argv[0] : isprog_lookup(argv[0]);
+	sbuf_init(&dir);
+	resolve_working_dir(&dir, working_dir);
+	if (vfork_exec(prog, argv, shell, arg, dir.len ? dir.buf : NULL) == -1)
+		die("unable to vfork()");
+	xfree(buf.buf);
+	xfree(dir.buf);
+}
+
+FILE *spawn_popen(const char *command, pid_t *pid)
+{
+	sigset_t all, old;
+	int fds[2];
+	FILE *fp;
+
+	if (pipe(fds) == -1)
+		return NULL;
+	/* so that other children do not hold the pipe open */
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	*pid = vfork();
+	if (*pid == 0) {
+		if (fds[1] == STDOUT_FILENO)
+			fcntl(fds[1], F_SETFD, 0);
+		else
+			dup2(fds[1], STDOUT_FILENO);
+		unblock_signals();
+		execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+		_exit(127);
 	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	close(fds[1]);
+	if (*pid == -1) {
+		close(fds[0]);
+		return NULL;
+	}
+	fp = fdopen(fds[0], "r");
+	if (!fp)
+		close(fds[0]);
+	return fp;
+}
+
+void spawn_pclose(FILE *fp, pid_t pid)
+{
+	fclose(fp);
+	/* fails with ECHILD if children are reaped automatically (see spawn()) */
+	while (waitpid(pid, NULL, 0) == -1 && errno == EINTR)
+		;
 }
 
 void spawn_sync(const char * const*command)
@@ -79,11 +207,17 @@ void spawn_sync(const char * const*command)
 		exit(EXIT_FAILURE);
 		break;
 	case 0: /* child */
+		unblock_signals();
 		execvp(command[0], (char * const*)command);
+		_exit(127);
 		break;
 	default: /* parent */
 		do {
 			w = waitpid(cpid, &wstatus, WUNTRACED | WCONTINUED);
+			if (w == -1 && errno == EINTR)
+				continue;
+			if (w == -1 && errno == ECHILD)
+				return;
 			if (w == -1) {
 				perror("waitpid");
 				exit(EXIT_FAILURE);
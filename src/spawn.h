@@ -11,8 +11,26 @@
 #include <limits.h>
 #include <errno.h>
 
+#define SPAWN_ARGS_MAX (64)
+
 void spawn(const char *arg, const char *working_dir);
 
+/**
+ * spawn_split_command - split a simple command into arguments
+ * @buf: command, which is split in place
+ * @argv: array of at least SPAWN_ARGS_MAX + 1 pointers, NULL-terminated
+ * Returns the number of arguments, or 0 if the shell is needed to run it.
+ */
+int spawn_split_command(char *buf, char **argv);
+
+/**
+ * spawn_popen - run @command with '/bin/sh -c' and read its output
+ * Like popen(), except that signals blocked by jgmenu (see loop.c) are not
+ * blocked in the child. Close with spawn_pclose().
+ */
+FILE *spawn_popen(const char *command, pid_t *pid);
+void spawn_pclose(FILE *fp, pid_t pid);
+
 /**
  * spawn_sync - execute and wait for child to finish
  * @command: array of command+arguments to be executed
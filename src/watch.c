@@ -3,15 +3,26 @@
  *
  * Copyright (C) Johan Malm 2018
  *
- * Watch files for change in "modified time" to advise when restart is
+ * Watch config files and menu data sources to advise when restart is
  * required.
+ *
+ * On Linux, inotify is used so that changes are picked up by the event loop
+ * as they happen. Each file is watched through its parent directory, which
+ * catches files being created, removed or replaced (as editors tend to do)
+ * as well as modified. Directories are also watched themselves for changes
+ * to their contents. Elsewhere, we fall back to comparing modification times
+ * in watch_changes().
  */
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
 #include <sys/stat.h>
-#include <sys/time.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
 #include "list.h"
 #include "sbuf.h"
@@ -20,49 +31,245 @@
 #include "config.h"
 #include "banned.h"
 
-static const char * const files_to_watch[] = {
-	"~/.config/jgmenu/jgmenurc",
-	"~/.config/jgmenu/prepend.csv",
-	"~/.config/jgmenu/append.csv",
-	"~/.config/tint2/tint2rc",
-	"~/.local/share/applications",
-	"/usr/share/applications",
-	"/usr/local/share/applications",
-	"/opt/share/applications",
-	"$XDG_DATA_DIRS/applications",
-	"~/.config/openbox/menu.xml",
-	NULL
+static const struct {
+	const char *filename;
+	int source;
+} files_to_watch[] = {
+	{ "~/.config/jgmenu/jgmenurc", WATCH_JGMENURC },
+	{ "~/.config/jgmenu/prepend.csv", WATCH_MENU },
+	{ "~/.config/jgmenu/append.csv", WATCH_MENU },
+	{ "~/.config/tint2/tint2rc", WATCH_TINT2RC },
+	{ "~/.config/openbox/menu.xml", WATCH_MENU },
+	{ NULL, 0 }
 };
 
+/* Relative to each of $XDG_DATA_HOME and $XDG_DATA_DIRS */
+static const char applications[] = "applications";
+
 static LIST_HEAD(watched_files);
 
 struct watched_file {
 	char *filename;
-	struct timeval tv;
+	const char *basename;
+	int source;
+	time_t mtime;		/* 0 if the file did not exist */
+	int parent_wd;
+	int wd;			/* set for directories only */
 	struct list_head list;
 };
 
-static void add_file(const char *filename)
+static int changes;
+
+#ifdef __linux__
+
+#define DIR_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+		    IN_CLOSE_WRITE | IN_MODIFY)
+#define PARENT_WATCH_MASK (DIR_EVENTS | IN_ONLYDIR | IN_MASK_ADD)
+#define DIR_WATCH_MASK (DIR_EVENTS | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_MASK_ADD)
+
+static int inotify_fd = -1;
+
+static void add_watches(struct watched_file *f)
+{
+	struct sbuf parent;
+	char *p;
+
+	f->parent_wd = -1;
+	f->wd = -1;
+	if (inotify_fd == -1)
+		return;
+	sbuf_init(&parent);
+	sbuf_cpy(&parent, f->filename);
+	p = strrchr(parent.buf, '/');
+	if (p && p != parent.buf) {
+		*p = '\0';
+		f->parent_wd = inotify_add_watch(inotify_fd, parent.buf, PARENT_WATCH_MASK);
+	}
+	if (f->parent_wd == -1 && config.verbosity >= 2)
+		info("cannot watch directory '%s'", parent.buf);
+	xfree(parent.buf);
+	/* also notice changes to the contents of directories */
+	f->wd = inotify_add_watch(inotify_fd, f->filename, DIR_WATCH_MASK);
+}
+
+static void watch_init_backend(void)
+{
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify_fd == -1)
+		warn("inotify_init1(): %s", strerror(errno));
+}
+
+static void process_event(struct inotify_event *ev)
+{
+	struct watched_file *f;
+
+	list_for_each_entry(f, &watched_files, list) {
+		if (ev->wd == f->parent_wd && ev->len && !strcmp(ev->name, f->basename)) {
+			/* a new directory has to be watched itself */
+			if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) && (ev->mask & IN_ISDIR))
+				f->wd = inotify_add_watch(inotify_fd, f->filename, DIR_WATCH_MASK);
+		} else if (ev->wd != f->wd) {
+			continue;
+		}
+		if (!(changes & f->source) && config.verbosity >= 2)
+			info("file/dir changed '%s'", f->filename);
+		changes |= f->source;
+	}
+}
+
+void watch_process(void)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ev;
+	ssize_t len;
+	char *p;
+
+	if (inotify_fd == -1)
+		return;
+	while ((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + len; p += sizeof(*ev) + ev->len) {
+			ev = (struct inotify_event *)p;
+			process_event(ev);
+		}
+	}
+}
+
+int watch_fd(void)
+{
+	return inotify_fd;
+}
+
+int watch_changes(void)
+{
+	watch_process();
+	return changes;
+}
+
+static void watch_cleanup_backend(void)
+{
+	if (inotify_fd != -1)
+		close(inotify_fd);
+	inotify_fd = -1;
+}
+
+#else /* !__linux__ */
+
+static void add_watches(struct watched_file *f)
+{
+	f->parent_wd = -1;
+	f->wd = -1;
+}
+
+static void watch_init_backend(void)
+{
+}
+
+void watch_process(void)
+{
+}
+
+int watch_fd(void)
+{
+	return -1;
+}
+
+int watch_changes(void)
+{
+	struct watched_file *f;
+	struct stat sb;
+	time_t mtime;
+
+	list_for_each_entry(f, &watched_files, list) {
+		mtime = stat(f->filename, &sb) == -1 ? 0 : sb.st_mtime;
+		if (mtime == f->mtime)
+			continue;
+		if (!(changes & f->source) && config.verbosity >= 2)
+			info("file/dir changed '%s'", f->filename);
+		changes |= f->source;
+	}
+	return changes;
+}
+
+static void watch_cleanup_backend(void)
+{
+}
+
+#endif /* __linux__ */
+
+static void add_file(const char *filename, int source)
 {
 	struct stat sb;
-	struct watched_file *watched_file;
-	struct sbuf f;
-
-	sbuf_init(&f);
-	sbuf_addstr(&f, filename);
-	sbuf_expand_tilde(&f);
-	sbuf_expand_env_var(&f);
-	watched_file = malloc(sizeof(struct watched_file));
-	watched_file->filename = f.buf;
+	struct watched_file *f;
+	struct sbuf s;
+	char *p;
+
+	sbuf_init(&s);
+	sbuf_addstr(&s, filename);
+	sbuf_expand_tilde(&s);
+	sbuf_expand_env_var(&s);
+	f = xcalloc(1, sizeof(struct watched_file));
+	f->filename = s.buf;
+	p = strrchr(f->filename, '/');
+	f->basename = p ? p + 1 : f->filename;
+	f->source = source;
 	/*
 	 * We add files even if they don't yet exist in order to be able
 	 * to detect if they are added in the future.
 	 */
-	if (stat(f.buf, &sb) == -1)
-		watched_file->tv.tv_sec = 0;
+	if (stat(f->filename, &sb) == 0)
+		f->mtime = sb.st_mtime;
+	add_watches(f);
+	list_add_tail(&f->list, &watched_files);
+}
+
+static void add_applications_dir(const char *data_dir)
+{
+	struct sbuf s;
+	struct watched_file *f;
+
+	if (!data_dir || data_dir[0] == '\0')
+		return;
+	sbuf_init(&s);
+	sbuf_cpy(&s, data_dir);
+	sbuf_expand_tilde(&s);
+	if (s.buf[s.len - 1] != '/')
+		sbuf_addch(&s, '/');
+	sbuf_addstr(&s, applications);
+	list_for_each_entry(f, &watched_files, list)
+		if (!strcmp(f->filename, s.buf))
+			goto out;
+	add_file(s.buf, WATCH_MENU);
+out:
+	xfree(s.buf);
+}
+
+/* Add one 'applications' directory for each XDG data directory */
+static void add_applications_dirs(void)
+{
+	struct sbuf dirs;
+	char *xdg_data_home, *xdg_data_dirs, *dir, *next;
+
+	xdg_data_home = getenv("XDG_DATA_HOME");
+	if (xdg_data_home && xdg_data_home[0] != '\0')
+		add_applications_dir(xdg_data_home);
 	else
-		watched_file->tv.tv_sec = sb.st_mtime;
-	list_add_tail(&watched_file->list, &watched_files);
+		add_applications_dir("~/.local/share");
+
+	sbuf_init(&dirs);
+	xdg_data_dirs = getenv("XDG_DATA_DIRS");
+	if (xdg_data_dirs && xdg_data_dirs[0] != '\0') {
+		sbuf_cpy(&dirs, xdg_data_dirs);
+		sbuf_addch(&dirs, ':');
+	}
+	/* used by the csv generators whatever $XDG_DATA_DIRS says */
+	sbuf_addstr(&dirs, "/usr/local/share:/usr/share:/opt/share");
+	for (dir = dirs.buf; dir; dir = next) {
+		next = strchr(dir, ':');
+		if (next)
+			*next++ = '\0';
+		add_applications_dir(dir);
+	}
+	xfree(dirs.buf);
 }
 
 void watch_init(void)
@@ -73,44 +280,17 @@ void watch_init(void)
 	if (done)
 		return;
 	done = 1;
-	for (i = 0; files_to_watch[i]; i++)
-		add_file(files_to_watch[i]);
-}
-
-int watch_files_have_changed(void)
-{
-	struct watched_file *f;
-	struct stat sb;
-
-	watch_init();
-	list_for_each_entry(f, &watched_files, list) {
-		if (stat(f->filename, &sb) == -1) {
-			if (!f->tv.tv_sec) {
-				continue;
-			} else {
-				if (config.verbosity >= 2)
-					info("file/dir removed '%s'",
-					     f->filename);
-				return 1;
-			}
-		}
-		if (f->tv.tv_sec != sb.st_mtime) {
-			if (config.verbosity < 2)
-				return 1;
-			if (!f->tv.tv_sec)
-				info("file/dir added '%s'", f->filename);
-			else
-				info("file/dir changed '%s'", f->filename);
-			return 1;
-		}
-	}
-	return 0;
+	watch_init_backend();
+	for (i = 0; files_to_watch[i].filename; i++)
+		add_file(files_to_watch[i].filename, files_to_watch[i].source);
+	add_applications_dirs();
 }
 
 void watch_cleanup(void)
 {
 	struct watched_file *f, *tmp;
 
+	watch_cleanup_backend();
 	list_for_each_entry_safe(f, tmp, &watched_files, list) {
 		xfree(f->filename);
 		list_del(&f->list);
@@ -1,8 +1,28 @@
 #ifndef WATCH_H
 #define WATCH_H
 
+/* Sources which can change, as returned by watch_changes() */
+#define WATCH_JGMENURC	(1 << 0)
+#define WATCH_TINT2RC	(1 << 1)
+#define WATCH_MENU	(1 << 2)	/* input to csv generators */
+
 void watch_init(void);
-int watch_files_have_changed(void);
+
+/**
+ * watch_fd - file descriptor which becomes readable when a watched file
+ * changes, or -1 if changes can only be found by polling watch_changes()
+ */
+int watch_fd(void);
+
+/* watch_process - read pending notifications from watch_fd() */
+void watch_process(void);
+
+/**
+ * watch_changes - sources which have changed since watch_init()
+ * Returns a bitwise OR of WATCH_* values
+ */
+int watch_changes(void);
+
 void watch_cleanup(void);
 
 #endif /* WATCH_H */
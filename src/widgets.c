@@ -252,6 +252,11 @@ static void color_copy(double to[4], double from[4])
 		to[i] = from[i];
 }
 
+int widgets_exist(void)
+{
+	return !list_empty(&widgets);
+}
+
 void widgets_add(const char *s)
 {
 	struct argv_buf argv_buf;
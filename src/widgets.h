@@ -8,6 +8,7 @@ int widgets_mouseover(void);
 void widgets_set_pointer_position(int x, int y);
 char *widgets_get_selection_action(void);
 void widgets_draw(void);
+int widgets_exist(void);
 void widgets_add(const char *s);
 void widgets_cleanup(void);
 
@@ -0,0 +1,135 @@
+/*
+ * workers.c
+ *
+ * Copyright (C) Johan Malm 2019
+ *
+ * A small pool of long-lived threads for work which can be split into
+ * independent jobs (e.g. matching the filter needle against a large number
+ * of menu items).
+ *
+ * The threads are created on first use and kept until exit, so that we do
+ * not pay the cost of pthread_create() on every key stroke.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "workers.h"
+#include "util.h"
+#include "banned.h"
+
+#define WORKERS_MAX (8)
+
+static pthread_t threads[WORKERS_MAX];
+static int nr_threads = -1;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+/* The current batch of jobs. Protected by 'mutex'. */
+static struct {
+	void (*fn)(void *arg, int job);
+	void *arg;
+	int nr_jobs;
+	int next_job;
+	int nr_done;
+	unsigned int generation;
+} batch;
+
+static int quit;
+
+/* Run jobs until there are none left. Called with 'mutex' held. */
+static void process_jobs(void)
+{
+	int job;
+
+	while (batch.next_job < batch.nr_jobs) {
+		job = batch.next_job++;
+		pthread_mutex_unlock(&mutex);
+		batch.fn(batch.arg, job);
+		pthread_mutex_lock(&mutex);
+		if (++batch.nr_done == batch.nr_jobs)
+			pthread_cond_signal(&done_cond);
+	}
+}
+
+static void *worker(void *arg)
+{
+	unsigned int generation = 0;
+
+	pthread_mutex_lock(&mutex);
+	for (;;) {
+		while (!quit && batch.generation == generation)
+			pthread_cond_wait(&work_cond, &mutex);
+		if (quit)
+			break;
+		generation = batch.generation;
+		process_jobs();
+	}
+	pthread_mutex_unlock(&mutex);
+	return NULL;
+}
+
+static void workers_init(void)
+{
+	long nr_cpus;
+	int i;
+
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	/* the calling thread does its share of the work */
+	nr_threads = nr_cpus > 1 ? nr_cpus - 1 : 0;
+	if (nr_threads > WORKERS_MAX)
+		nr_threads = WORKERS_MAX;
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&threads[i], NULL, worker, NULL)) {
+			warn("could not create worker thread");
+			break;
+		}
+	}
+	nr_threads = i;
+}
+
+int workers_nr(void)
+{
+	if (nr_threads < 0)
+		workers_init();
+	return nr_threads + 1;
+}
+
+void workers_parallel(void (*fn)(void *arg, int job), void *arg, int nr_jobs)
+{
+	if (nr_jobs <= 0)
+		return;
+	if (nr_threads < 0)
+		workers_init();
+
+	pthread_mutex_lock(&mutex);
+	batch.fn = fn;
+	batch.arg = arg;
+	batch.nr_jobs = nr_jobs;
+	batch.next_job = 0;
+	batch.nr_done = 0;
+	batch.generation++;
+	pthread_cond_broadcast(&work_cond);
+	process_jobs();
+	while (batch.nr_done < batch.nr_jobs)
+		pthread_cond_wait(&done_cond, &mutex);
+	pthread_mutex_unlock(&mutex);
+}
+
+void workers_cleanup(void)
+{
+	int i;
+
+	if (nr_threads <= 0)
+		return;
+	pthread_mutex_lock(&mutex);
+	quit = 1;
+	pthread_cond_broadcast(&work_cond);
+	pthread_mutex_unlock(&mutex);
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	quit = 0;
+	nr_threads = -1;
+}
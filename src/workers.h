@@ -0,0 +1,23 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+/**
+ * workers_nr - number of threads (including the caller) taking part in
+ * workers_parallel()
+ */
+int workers_nr(void);
+
+/**
+ * workers_parallel - run @fn for each job in the range [0, @nr_jobs)
+ * @fn: function to call; must not call any X functions
+ * @arg: passed unchanged to @fn
+ * @nr_jobs: number of jobs
+ *
+ * Jobs are shared between the pool threads and the calling thread. The
+ * function returns once all jobs have been completed.
+ */
+void workers_parallel(void (*fn)(void *arg, int job), void *arg, int nr_jobs);
+
+void workers_cleanup(void);
+
+#endif /* WORKERS_H */
@@ -23,6 +23,9 @@
 #include <X11/Xatom.h>
 #include <X11/Xutil.h>
 #include <X11/extensions/Xrandr.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 
 #include "x11-ui.h"
 #include "util.h"
@@ -31,6 +34,45 @@
 
 struct UI *ui;
 
+/*
+ * In offscreen mode there is no X display. Canvases are image surfaces,
+ * windows are just canvases and the screen has a fixed size.
+ */
+static int offscreen;
+static int offscreen_w, offscreen_h;
+
+/*
+ * The drawing functions below paint on the current window's canvas, unless
+ * the calling thread has set a target of its own with ui_draw_target_set()
+ */
+static __thread struct {
+	cairo_t *c;
+	PangoLayout *layout;
+	PangoFontDescription *font;
+} target;
+
+void ui_draw_target_set(cairo_t *c, PangoLayout *layout, PangoFontDescription *font)
+{
+	target.c = c;
+	target.layout = layout;
+	target.font = font;
+}
+
+static cairo_t *cr(void)
+{
+	return target.c ? target.c : ui->w[ui->cur].c;
+}
+
+static PangoLayout *layout(void)
+{
+	return target.c ? target.layout : ui->w[ui->cur].pangolayout;
+}
+
+static PangoFontDescription *fontdesc(void)
+{
+	return target.c ? target.font : ui->w[ui->cur].pangofont;
+}
+
 static void *win_prop(Window win, Atom property, Atom req_type)
 {
 	Atom actual_type_return;
@@ -53,6 +95,8 @@ int ui_get_workarea(struct area *a)
 {
 	long *wa;
 
+	if (offscreen)
+		return -1;
 	wa = win_prop(ui->root, XInternAtom(ui->dpy, "_NET_WORKAREA", False),
 		      XA_CARDINAL);
 	if (!wa)
@@ -65,13 +109,23 @@ int ui_get_workarea(struct area *a)
 	return 0;
 }
 
+static int shm_busy;
+
 void ui_clear_canvas(void)
 {
-	cairo_save(ui->w[ui->cur].c);
-	cairo_set_source_rgba(ui->w[ui->cur].c, 0.0, 0.0, 0.0, 0.0);
-	cairo_set_operator(ui->w[ui->cur].c, CAIRO_OPERATOR_SOURCE);
-	cairo_paint(ui->w[ui->cur].c);
-	cairo_restore(ui->w[ui->cur].c);
+	/*
+	 * With MIT-SHM, the server may still be reading the previous frame
+	 * from the canvas.
+	 */
+	if (shm_busy && !target.c) {
+		XSync(ui->dpy, False);
+		shm_busy = 0;
+	}
+	cairo_save(cr());
+	cairo_set_source_rgba(cr(), 0.0, 0.0, 0.0, 0.0);
+	cairo_set_operator(cr(), CAIRO_OPERATOR_SOURCE);
+	cairo_paint(cr());
+	cairo_restore(cr());
 }
 
 void grabkeyboard(void)
@@ -136,6 +190,28 @@ void ui_init(void)
 
 	ui->screen = DefaultScreen(ui->dpy);
 	ui->root = RootWindow(ui->dpy, ui->screen);
+	ui->colormap = XCreateColormap(ui->dpy, ui->root, ui->vinfo.visual, AllocNone);
+
+	/*
+	 * XDefineCursor required to prevent blindly inheriting cursor from parent
+	 * (e.g. hour-glass pointer set by tint2)
+	 * Check this URL for cursor styles:
+	 * http://tronche.com/gui/x/xlib/appendix/b/
+	 */
+	ui->cursor = XCreateFontCursor(ui->dpy, 68);
+}
+
+void ui_init_offscreen(int screen_width, int screen_height)
+{
+	ui = xcalloc(1, sizeof(*ui));
+	offscreen = 1;
+	offscreen_w = screen_width;
+	offscreen_h = screen_height;
+}
+
+int ui_is_offscreen(void)
+{
+	return offscreen;
 }
 
 static void print_screen_info(void)
@@ -176,6 +252,13 @@ void ui_get_screen_res(int *x0, int *y0, int *width, int *height, int monitor)
 	XRRScreenResources *sr;
 	XRRCrtcInfo *ci = NULL;
 
+	if (offscreen) {
+		*x0 = 0;
+		*y0 = 0;
+		*width = offscreen_w;
+		*height = offscreen_h;
+		return;
+	}
 	if (config.verbosity >= 3)
 		print_screen_info();
 	sr = XRRGetScreenResourcesCurrent(ui->dpy, DefaultRootWindow(ui->dpy));
@@ -223,96 +306,481 @@ monitor_selected:
 	XRRFreeScreenResources(sr);
 }
 
-static void set_wm_class(void)
+static void set_wm_class(Window win)
 {
 	XClassHint *classhint = XAllocClassHint();
 
 	classhint->res_name = (char *)"jgmenu";
 	classhint->res_class = (char *)"jgmenu";
-	XSetClassHint(ui->dpy, ui->w[ui->cur].win, classhint);
+	XSetClassHint(ui->dpy, win, classhint);
 	XFree(classhint);
 }
 
+/*
+ * Closed windows are unmapped and kept here together with their input
+ * context, GC and pango layout, so that opening a submenu does not involve
+ * creating them again.
+ */
+#define WIN_POOL_MAX (MAX_NR_WINDOWS)
+static struct window_data win_pool[WIN_POOL_MAX];
+static int nr_pooled_windows;
+
+static void win_create(struct window_data *wd, int x, int y, int w, int h)
+{
+	wd->swa.override_redirect = True;
+	wd->swa.event_mask = ExposureMask | KeyPressMask | VisibilityChangeMask | ButtonPressMask;
+	wd->swa.colormap = ui->colormap;
+	wd->swa.background_pixel = 0;
+	wd->swa.border_pixel = 0;
+
+	wd->win = XCreateWindow(ui->dpy, ui->root, x, y, w, h, 0,
+				ui->vinfo.depth, CopyFromParent,
+				ui->vinfo.visual,
+				CWOverrideRedirect | CWColormap |
+				CWBackPixel | CWEventMask |
+				CWBorderPixel,
+				&wd->swa);
+	wd->xic = XCreateIC(ui->xim, XNInputStyle, XIMPreeditNothing | XIMStatusNothing,
+			    XNClientWindow, wd->win, XNFocusWindow, wd->win, NULL);
+
+	wd->gc = XCreateGC(ui->dpy, wd->win, 0, NULL);
+
+	XStoreName(ui->dpy, wd->win, "jgmenu");
+	XSetIconName(ui->dpy, wd->win, "jgmenu");
+	set_wm_class(wd->win);
+	XDefineCursor(ui->dpy, wd->win, ui->cursor);
+	wd->pangolayout = NULL;
+}
+
+static void win_destroy(struct window_data *wd)
+{
+	if (offscreen)
+		return;
+	XDestroyIC(wd->xic);
+	XFreeGC(ui->dpy, wd->gc);
+	XDestroyWindow(ui->dpy, wd->win);
+	if (wd->pangolayout)
+		g_object_unref(wd->pangolayout);
+}
+
+static void win_pool_cleanup(void)
+{
+	while (nr_pooled_windows)
+		win_destroy(&win_pool[--nr_pooled_windows]);
+}
+
+/* Pre-create @nr windows, so that the first submenus open quickly too */
+void ui_win_pool_fill(int nr)
+{
+	if (offscreen)
+		return;
+	if (nr > WIN_POOL_MAX)
+		nr = WIN_POOL_MAX;
+	while (nr_pooled_windows < nr)
+		win_create(&win_pool[nr_pooled_windows++], 0, 0, 1, 1);
+}
+
 void ui_create_window(int x, int y, int w, int h)
 {
-	ui->w[ui->cur].swa.override_redirect = True;
-	ui->w[ui->cur].swa.event_mask = ExposureMask | KeyPressMask | VisibilityChangeMask | ButtonPressMask;
-	ui->w[ui->cur].swa.colormap = XCreateColormap(ui->dpy, DefaultRootWindow(ui->dpy), ui->vinfo.visual, AllocNone);
-	ui->w[ui->cur].swa.background_pixel = 0;
-	ui->w[ui->cur].swa.border_pixel = 0;
+	struct window_data *wd = &ui->w[ui->cur];
 
-	ui->w[ui->cur].win = XCreateWindow(ui->dpy, ui->root, x, y, w, h, 0,
-					   ui->vinfo.depth, CopyFromParent,
-					   ui->vinfo.visual,
-					   CWOverrideRedirect | CWColormap |
-					   CWBackPixel | CWEventMask |
-					   CWBorderPixel,
-					   &ui->w[ui->cur].swa);
-	ui->w[ui->cur].xic = XCreateIC(ui->xim, XNInputStyle, XIMPreeditNothing | XIMStatusNothing,
-			    XNClientWindow, ui->w[ui->cur].win, XNFocusWindow, ui->w[ui->cur].win, NULL);
+	wd->x = x;
+	wd->y = y;
+	if (offscreen) {
+		/* any unique, non-zero id will do */
+		wd->win = ui->cur + 1;
+		return;
+	}
+	if (!nr_pooled_windows) {
+		win_create(wd, x, y, w, h);
+		return;
+	}
+	--nr_pooled_windows;
+	wd->win = win_pool[nr_pooled_windows].win;
+	wd->xic = win_pool[nr_pooled_windows].xic;
+	wd->swa = win_pool[nr_pooled_windows].swa;
+	wd->gc = win_pool[nr_pooled_windows].gc;
+	wd->pangolayout = win_pool[nr_pooled_windows].pangolayout;
+	XMoveResizeWindow(ui->dpy, wd->win, x, y, w, h);
+}
 
-	ui->w[ui->cur].gc = XCreateGC(ui->dpy, ui->w[ui->cur].win, 0, NULL);
+void ui_win_move_resize(int x, int y, int w, int h)
+{
+	ui->w[ui->cur].x = x;
+	ui->w[ui->cur].y = y;
+	if (offscreen)
+		return;
+	XMoveResizeWindow(ui->dpy, ui->w[ui->cur].win, x, y, w, h);
+}
 
-	XStoreName(ui->dpy, ui->w[ui->cur].win, "jgmenu");
-	XSetIconName(ui->dpy, ui->w[ui->cur].win, "jgmenu");
-	set_wm_class();
+/* Replace the contents of the current window's canvas with @image */
+void ui_canvas_paint(cairo_surface_t *image)
+{
+	cairo_t *c = ui->w[ui->cur].c;
 
-	/*
-	 * XDefineCursor required to prevent blindly inheriting cursor from parent
-	 * (e.g. hour-glass pointer set by tint2)
-	 * Check this URL for cursor styles:
-	 * http://tronche.com/gui/x/xlib/appendix/b/
-	 */
-	XDefineCursor(ui->dpy, ui->w[ui->cur].win, XCreateFontCursor(ui->dpy, 68));
+	if (shm_busy) {
+		XSync(ui->dpy, False);
+		shm_busy = 0;
+	}
+	cairo_save(c);
+	cairo_set_source_surface(c, image, 0, 0);
+	cairo_set_operator(c, CAIRO_OPERATOR_SOURCE);
+	cairo_paint(c);
+	cairo_restore(c);
+}
+
+/* Save the top-left @w x @h pixels of the current canvas as a PNG file */
+int ui_canvas_write_png(const char *filename, int w, int h)
+{
+	cairo_surface_t *image;
+	cairo_t *c;
+	cairo_status_t status;
+
+	image = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+	c = cairo_create(image);
+	cairo_set_source_surface(c, ui->w[ui->cur].cs, 0, 0);
+	cairo_set_operator(c, CAIRO_OPERATOR_SOURCE);
+	cairo_paint(c);
+	cairo_destroy(c);
+	status = cairo_surface_write_to_png(image, filename);
+	cairo_surface_destroy(image);
+	return status == CAIRO_STATUS_SUCCESS ? 0 : -1;
+}
+
+/* Move rows [y, y + h) of the current canvas by @dy pixels */
+void ui_canvas_scroll(int y, int h, int dy)
+{
+	struct window_data *wd = &ui->w[ui->cur];
+	unsigned char *data;
+	int stride;
+
+	cairo_surface_flush(wd->cs);
+	if (cairo_surface_get_type(wd->cs) == CAIRO_SURFACE_TYPE_XLIB) {
+		XCopyArea(ui->dpy, wd->canvas, wd->canvas, wd->gc, 0, y,
+			  wd->canvas_w, h, 0, y + dy);
+	} else {
+		if (shm_busy) {
+			XSync(ui->dpy, False);
+			shm_busy = 0;
+		}
+		data = cairo_image_surface_get_data(wd->cs);
+		stride = cairo_image_surface_get_stride(wd->cs);
+		memmove(data + (y + dy) * stride, data + y * stride, h * stride);
+	}
+	cairo_surface_mark_dirty(wd->cs);
+}
+
+/*
+ * Canvases are sized to the window they belong to and are recycled through
+ * a small pool when windows are closed. Sizes are rounded up to a multiple
+ * of CANVAS_GRAIN so that submenus of similar size can share them.
+ */
+#define CANVAS_GRAIN (64)
+#define CANVAS_POOL_MAX (8)
+
+struct canvas {
+	Pixmap pixmap;
+	XImage *shmimage;
+	XShmSegmentInfo shminfo;
+	cairo_surface_t *cs;
+	int w, h;
+};
+
+static struct canvas canvas_pool[CANVAS_POOL_MAX];
+static int nr_pooled_canvases;
+
+static int canvas_size_class(int n)
+{
+	if (n < 1)
+		n = 1;
+	return (n + CANVAS_GRAIN - 1) / CANVAS_GRAIN * CANVAS_GRAIN;
+}
+
+/*
+ * If 'mit_shm' is set, canvases are client-side image surfaces in memory
+ * shared with the X server. Drawing then involves no X protocol at all, and
+ * the damaged areas are transferred with XShmPutImage(). We fall back to
+ * pixmaps if the extension is missing or cannot be used (e.g. on a remote
+ * display).
+ */
+static int shm_usable = -1;
+static int shm_error;
+
+static int shm_error_handler(Display *dpy, XErrorEvent *e)
+{
+	shm_error = 1;
+	return 0;
+}
+
+static void shm_disable(const char *reason)
+{
+	warn("MIT-SHM %s; using pixmaps", reason);
+	shm_usable = 0;
+}
+
+static int host_byte_order(void)
+{
+	unsigned int one = 1;
+
+	return *(unsigned char *)&one ? LSBFirst : MSBFirst;
+}
+
+static void shm_image_destroy(struct canvas *canvas)
+{
+	canvas->shmimage->data = NULL;
+	XDestroyImage(canvas->shmimage);
+	canvas->shmimage = NULL;
+}
+
+static int shm_canvas_create(struct canvas *canvas, int width, int height)
+{
+	XErrorHandler handler;
+	XImage *image;
+
+	if (shm_usable < 0 && !XShmQueryExtension(ui->dpy))
+		shm_disable("extension not available");
+	if (!shm_usable)
+		return -1;
+	shm_usable = 1;
+
+	image = XShmCreateImage(ui->dpy, ui->vinfo.visual, 32, ZPixmap, NULL,
+				&canvas->shminfo, width, height);
+	if (!image)
+		return -1;
+	canvas->shmimage = image;
+	if (image->bits_per_pixel != 32 || image->byte_order != host_byte_order() ||
+	    image->bytes_per_line != cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width)) {
+		shm_disable("image format not supported");
+		goto fail_image;
+	}
+	canvas->shminfo.shmid = shmget(IPC_PRIVATE, image->bytes_per_line * height,
+				       IPC_CREAT | 0600);
+	if (canvas->shminfo.shmid < 0)
+		goto fail_image;
+	canvas->shminfo.shmaddr = shmat(canvas->shminfo.shmid, NULL, 0);
+	if (canvas->shminfo.shmaddr == (char *)-1)
+		goto fail_shmget;
+	image->data = canvas->shminfo.shmaddr;
+	canvas->shminfo.readOnly = False;
+
+	/* XShmAttach() fails asynchronously, for example on remote displays */
+	shm_error = 0;
+	handler = XSetErrorHandler(shm_error_handler);
+	XShmAttach(ui->dpy, &canvas->shminfo);
 	XSync(ui->dpy, False);
+	XSetErrorHandler(handler);
+	if (shm_error) {
+		shm_disable("cannot attach");
+		goto fail_shmat;
+	}
+	/* the segment goes once both we and the server have detached */
+	shmctl(canvas->shminfo.shmid, IPC_RMID, NULL);
+
+	canvas->pixmap = None;
+	canvas->cs = cairo_image_surface_create_for_data((unsigned char *)image->data,
+							 CAIRO_FORMAT_ARGB32,
+							 width, height,
+							 image->bytes_per_line);
+	return 0;
+
+fail_shmat:
+	shmdt(canvas->shminfo.shmaddr);
+fail_shmget:
+	shmctl(canvas->shminfo.shmid, IPC_RMID, NULL);
+fail_image:
+	shm_image_destroy(canvas);
+	return -1;
+}
+
+static void canvas_free(struct canvas *canvas)
+{
+	cairo_surface_destroy(canvas->cs);
+	if (offscreen)
+		return;
+	if (!canvas->shmimage) {
+		XFreePixmap(ui->dpy, canvas->pixmap);
+		return;
+	}
+	XShmDetach(ui->dpy, &canvas->shminfo);
+	shm_image_destroy(canvas);
+	shmdt(canvas->shminfo.shmaddr);
+}
+
+/*
+ * Take the smallest pooled canvas which is big enough, but not more than
+ * twice the area needed. Create a new one if there is no such canvas.
+ */
+static void canvas_get(struct canvas *canvas, int width, int height)
+{
+	int i, best = -1;
+	long area, best_area = 0;
+
+	width = canvas_size_class(width);
+	height = canvas_size_class(height);
+	for (i = 0; i < nr_pooled_canvases; i++) {
+		if (canvas_pool[i].w < width || canvas_pool[i].h < height)
+			continue;
+		area = (long)canvas_pool[i].w * canvas_pool[i].h;
+		if (area > 2L * width * height)
+			continue;
+		if (best < 0 || area < best_area) {
+			best = i;
+			best_area = area;
+		}
+	}
+	if (best >= 0) {
+		*canvas = canvas_pool[best];
+		canvas_pool[best] = canvas_pool[--nr_pooled_canvases];
+		return;
+	}
+	canvas->w = width;
+	canvas->h = height;
+	canvas->shmimage = NULL;
+	if (offscreen) {
+		canvas->pixmap = None;
+		canvas->cs = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+							width, height);
+		return;
+	}
+	if (config.mit_shm && !shm_canvas_create(canvas, width, height))
+		return;
+	canvas->pixmap = XCreatePixmap(ui->dpy, ui->root, width, height, 32);
+	canvas->cs = cairo_xlib_surface_create(ui->dpy, canvas->pixmap,
+					       ui->vinfo.visual, width, height);
+}
+
+static void canvas_put(struct canvas *canvas)
+{
+	if (nr_pooled_canvases == CANVAS_POOL_MAX) {
+		/* evict the oldest */
+		canvas_free(&canvas_pool[0]);
+		memmove(&canvas_pool[0], &canvas_pool[1],
+			(CANVAS_POOL_MAX - 1) * sizeof(struct canvas));
+		nr_pooled_canvases--;
+	}
+	canvas_pool[nr_pooled_canvases++] = *canvas;
+}
+
+static void canvas_pool_cleanup(void)
+{
+	while (nr_pooled_canvases)
+		canvas_free(&canvas_pool[--nr_pooled_canvases]);
+}
+
+static void win_canvas_set(struct canvas *canvas)
+{
+	ui->w[ui->cur].canvas = canvas->pixmap;
+	ui->w[ui->cur].shmimage = canvas->shmimage;
+	ui->w[ui->cur].shminfo = canvas->shminfo;
+	ui->w[ui->cur].cs = canvas->cs;
+	ui->w[ui->cur].canvas_w = canvas->w;
+	ui->w[ui->cur].canvas_h = canvas->h;
+}
+
+static void win_canvas_put(int win_index)
+{
+	struct canvas canvas;
+
+	canvas.pixmap = ui->w[win_index].canvas;
+	canvas.shmimage = ui->w[win_index].shmimage;
+	canvas.shminfo = ui->w[win_index].shminfo;
+	canvas.cs = ui->w[win_index].cs;
+	canvas.w = ui->w[win_index].canvas_w;
+	canvas.h = ui->w[win_index].canvas_h;
+	canvas_put(&canvas);
+}
+
+/*
+ * Text caches are rendered onto transparent surfaces, so cannot have subpixel
+ * anti-aliasing. When that is in use, text is drawn directly onto the canvas
+ * instead. This depends on the canvas and the layout's context, so is worked
+ * out whenever either is set up rather than on every draw.
+ */
+static void text_cache_check_usable(void)
+{
+	static int noted;
+	struct window_data *wd = &ui->w[ui->cur];
+	cairo_font_options_t *options;
+	const cairo_font_options_t *context_options;
+	PangoContext *context;
+
+	options = cairo_font_options_create();
+	cairo_surface_get_font_options(wd->cs, options);
+	context = pango_layout_get_context(wd->pangolayout);
+	context_options = pango_cairo_context_get_font_options(context);
+	if (context_options)
+		cairo_font_options_merge(options, context_options);
+	wd->text_cache_usable = cairo_font_options_get_antialias(options) !=
+				CAIRO_ANTIALIAS_SUBPIXEL;
+	cairo_font_options_destroy(options);
+	if (!wd->text_cache_usable && !noted) {
+		info("subpixel anti-aliasing is in use, so text is not cached");
+		noted = 1;
+	}
+}
+
+void ui_init_canvas(int width, int height)
+{
+	struct canvas canvas;
+
+	canvas_get(&canvas, width, height);
+	win_canvas_set(&canvas);
 }
 
 /*
- * max_height is that associated with the longest submenu
+ * Make sure the current canvas is at least width x height. This is needed
+ * when a window grows, for example on ^root() in dynamic height mode.
  */
-void ui_init_canvas(int max_width, int max_height)
+void ui_canvas_ensure(int width, int height)
 {
-	ui->w[ui->cur].canvas = XCreatePixmap(ui->dpy, ui->root, max_width,
-					      max_height, 32);
+	struct canvas canvas;
+
+	if (width <= ui->w[ui->cur].canvas_w && height <= ui->w[ui->cur].canvas_h)
+		return;
+	win_canvas_put(ui->cur);
+	canvas_get(&canvas, MAX(width, ui->w[ui->cur].canvas_w),
+		   MAX(height, ui->w[ui->cur].canvas_h));
+	win_canvas_set(&canvas);
+	cairo_destroy(ui->w[ui->cur].c);
+	ui->w[ui->cur].c = cairo_create(ui->w[ui->cur].cs);
+	text_cache_check_usable();
 }
 
-void ui_init_cairo(int canvas_width, int canvas_height, const char *font)
+void ui_init_cairo(const char *font)
 {
 	struct point p;
 
-	ui->w[ui->cur].cs = cairo_xlib_surface_create(ui->dpy,
-						      ui->w[ui->cur].canvas,
-						      ui->vinfo.visual,
-						      canvas_width,
-						      canvas_height);
 	ui->w[ui->cur].c = cairo_create(ui->w[ui->cur].cs);
 
 	/*
 	 * pango-font-description-from-string() interprets the size without
 	 * a suffix as "points". If "px" is added, it will be read as pixels.
 	 */
-	ui->w[ui->cur].pangolayout = pango_cairo_create_layout(ui->w[ui->cur].c);
+	if (!ui->w[ui->cur].pangolayout)
+		ui->w[ui->cur].pangolayout = pango_cairo_create_layout(ui->w[ui->cur].c);
 	ui->w[ui->cur].pangofont = pango_font_description_from_string(font);
+	text_cache_check_usable();
 
 	p = ui_get_text_size("abcfghjklABC", font);
 	ui->font_height_actual = p.y;
 }
 
-void ui_win_init(int x, int y, int w, int h, int max_w, int max_h, const char *font)
+void ui_win_init(int x, int y, int w, int h, const char *font)
 {
 	ui->cur = 0;
 	ui_create_window(x, y, w, h);
-	ui_init_canvas(max_w, max_h);
-	ui_init_cairo(max_w, max_h, font);
+	ui_init_canvas(w, h);
+	ui_init_cairo(font);
 }
 
-void ui_win_add(int x, int y, int w, int h, int max_w, int max_h, const char *font)
+void ui_win_add(int x, int y, int w, int h, const char *font)
 {
 	ui->cur++;
 	ui_create_window(x, y, w, h);
-	ui_init_canvas(max_w, max_h);
-	ui_init_cairo(max_w, max_h, font);
-	XMapWindow(ui->dpy, ui->w[ui->cur].win);
+	ui_init_canvas(w, h);
+	ui_init_cairo(font);
+	if (!offscreen)
+		XMapWindow(ui->dpy, ui->w[ui->cur].win);
 }
 
 void ui_win_activate(Window w)
@@ -341,18 +809,21 @@ int ui_has_child_window_open(Window w)
 
 static void del_win(int win_index)
 {
-	if (!ui->w[win_index].c)
+	struct window_data *wd = &ui->w[win_index];
+
+	if (!wd->c)
 		die("there is not a window to delete");
-	XMapWindow(ui->dpy, ui->w[win_index].win);
-	XDestroyWindow(ui->dpy, ui->w[win_index].win);
-	XDestroyIC(ui->w[win_index].xic);
-	XFreePixmap(ui->dpy, ui->w[win_index].canvas);
-	XFreeGC(ui->dpy, ui->w[win_index].gc);
-	cairo_destroy(ui->w[win_index].c);
-	ui->w[win_index].c = NULL;
-	cairo_surface_destroy(ui->w[win_index].cs);
-	pango_font_description_free(ui->w[win_index].pangofont);
-	g_object_unref(ui->w[win_index].pangolayout);
+	if (!offscreen)
+		XUnmapWindow(ui->dpy, wd->win);
+	cairo_destroy(wd->c);
+	wd->c = NULL;
+	wd->nr_text_caches = 0;
+	win_canvas_put(win_index);
+	pango_font_description_free(wd->pangofont);
+	if (nr_pooled_windows < WIN_POOL_MAX)
+		win_pool[nr_pooled_windows++] = *wd;
+	else
+		win_destroy(wd);
 }
 
 void ui_win_del(void)
@@ -375,126 +846,379 @@ void ui_win_del_beyond(int w)
 	ui->cur = w;
 }
 
+int ui_win_is_open(Window w)
+{
+	int i;
+
+	for (i = 0; ui->w[i].c; i++)
+		if (w == ui->w[i].win)
+			return 1;
+	return 0;
+}
+
 void ui_draw_rectangle_rounded_at_top(double x, double y, double w, double h,
 				      double radius, double line_width, int fill, double *rgba)
 {
 	double deg = 0.017453292519943295; /* 2 x 3.1415927 / 360.0 */
 
-	cairo_new_sub_path(ui->w[ui->cur].c);
-	cairo_arc(ui->w[ui->cur].c, x + w - radius, y + radius, radius, -90 * deg, 0 * deg);  /* NE */
-	cairo_arc(ui->w[ui->cur].c, x + w, y + h, 0, 0 * deg, 90 * deg);			   /* SE */
-	cairo_arc(ui->w[ui->cur].c, x, y + h, 0, 90 * deg, 180 * deg);			   /* SW */
-	cairo_arc(ui->w[ui->cur].c, x + radius, y + radius, radius, 180 * deg, 270 * deg);    /* NE */
-	cairo_close_path(ui->w[ui->cur].c);
-	cairo_set_source_rgba(ui->w[ui->cur].c, rgba[0], rgba[1], rgba[2], rgba[3]);
+	cairo_new_sub_path(cr());
+	cairo_arc(cr(), x + w - radius, y + radius, radius, -90 * deg, 0 * deg);  /* NE */
+	cairo_arc(cr(), x + w, y + h, 0, 0 * deg, 90 * deg);			   /* SE */
+	cairo_arc(cr(), x, y + h, 0, 90 * deg, 180 * deg);			   /* SW */
+	cairo_arc(cr(), x + radius, y + radius, radius, 180 * deg, 270 * deg);    /* NE */
+	cairo_close_path(cr());
+	cairo_set_source_rgba(cr(), rgba[0], rgba[1], rgba[2], rgba[3]);
 	if (fill) {
-		cairo_set_line_width(ui->w[ui->cur].c, 0.0);
-		cairo_fill_preserve(ui->w[ui->cur].c);
+		cairo_set_line_width(cr(), 0.0);
+		cairo_fill_preserve(cr());
 	} else {
-		cairo_set_line_width(ui->w[ui->cur].c, line_width);
+		cairo_set_line_width(cr(), line_width);
 	}
-	cairo_stroke(ui->w[ui->cur].c);
+	cairo_stroke(cr());
 }
 
-void ui_draw_rectangle(double x, double y, double w, double h, double radius, double line_width, int fill, double *rgba)
+static void rectangle_draw(cairo_t *c, double x, double y, double w, double h,
+			   double radius, double line_width, int fill, double *rgba)
 {
 	x += line_width / 2;
 	y += line_width / 2;
 	w -= line_width;
 	h -= line_width;
 
-	cairo_set_line_width(ui->w[ui->cur].c, 0.0);
+	cairo_set_line_width(c, 0.0);
 	if (radius > 0) {
 		double deg = 0.017453292519943295; /* 2 x 3.1415927 / 360.0 */
 
-		cairo_new_sub_path(ui->w[ui->cur].c);
-		cairo_arc(ui->w[ui->cur].c, x + w - radius, y + radius, radius, -90 * deg, 0 * deg);
-		cairo_arc(ui->w[ui->cur].c, x + w - radius, y + h - radius, radius, 0 * deg, 90 * deg);
-		cairo_arc(ui->w[ui->cur].c, x + radius, y + h - radius, radius, 90 * deg, 180 * deg);
-		cairo_arc(ui->w[ui->cur].c, x + radius, y + radius, radius, 180 * deg, 270 * deg);
-		cairo_close_path(ui->w[ui->cur].c);
-		cairo_set_source_rgba(ui->w[ui->cur].c, rgba[0], rgba[1], rgba[2], rgba[3]);
+		cairo_new_sub_path(c);
+		cairo_arc(c, x + w - radius, y + radius, radius, -90 * deg, 0 * deg);
+		cairo_arc(c, x + w - radius, y + h - radius, radius, 0 * deg, 90 * deg);
+		cairo_arc(c, x + radius, y + h - radius, radius, 90 * deg, 180 * deg);
+		cairo_arc(c, x + radius, y + radius, radius, 180 * deg, 270 * deg);
+		cairo_close_path(c);
+		cairo_set_source_rgba(c, rgba[0], rgba[1], rgba[2], rgba[3]);
 		if (fill) {
-			cairo_set_line_width(ui->w[ui->cur].c, 0.0);
-			cairo_fill_preserve(ui->w[ui->cur].c);
+			cairo_set_line_width(c, 0.0);
+			cairo_fill_preserve(c);
 		} else {
-			cairo_set_line_width(ui->w[ui->cur].c, line_width);
+			cairo_set_line_width(c, line_width);
 		}
-		cairo_stroke(ui->w[ui->cur].c);
+		cairo_stroke(c);
 	} else {
-		cairo_set_source_rgba(ui->w[ui->cur].c, rgba[0], rgba[1], rgba[2], rgba[3]);
-		cairo_set_line_width(ui->w[ui->cur].c, line_width);
-		cairo_rectangle(ui->w[ui->cur].c, x, y, w, h);
+		cairo_set_source_rgba(c, rgba[0], rgba[1], rgba[2], rgba[3]);
+		cairo_set_line_width(c, line_width);
+		cairo_rectangle(c, x, y, w, h);
 		if (fill)
-			cairo_fill(ui->w[ui->cur].c);	/* FIXME Should line width be 0 here? */
+			cairo_fill(c);	/* FIXME Should line width be 0 here? */
 		else
-			cairo_stroke(ui->w[ui->cur].c);
+			cairo_stroke(c);
 	}
 }
 
+/*
+ * Rounded rectangles are rendered once into a tile and then just composited.
+ * Items, separators and widgets of a menu tend to share a small number of
+ * sizes and colours, so a few tiles go a long way. Each thread has a cache
+ * of its own, because tiles are similar to the surface they are painted on.
+ */
+#define TILE_CACHE_MAX (16)
+#define TILE_AREA_MAX (256 * 1024)
+
+struct tile {
+	cairo_surface_t *cs;
+	int w, h;
+	double radius, line_width;
+	int fill;
+	double rgba[4];
+	unsigned int last_used;
+};
+
+static __thread struct tile tiles[TILE_CACHE_MAX];
+static __thread unsigned int tile_clock;
+
+static int tile_matches(struct tile *t, int w, int h, double radius,
+			double line_width, int fill, double *rgba)
+{
+	return t->cs && t->w == w && t->h == h && t->radius == radius &&
+	       t->line_width == line_width && t->fill == fill &&
+	       !memcmp(t->rgba, rgba, sizeof(t->rgba));
+}
+
+static struct tile *tile_get(int w, int h, double radius, double line_width,
+			     int fill, double *rgba)
+{
+	struct tile *t, *lru = &tiles[0];
+	cairo_t *c;
+	int i;
+
+	for (i = 0; i < TILE_CACHE_MAX; i++) {
+		t = &tiles[i];
+		if (tile_matches(t, w, h, radius, line_width, fill, rgba))
+			goto out;
+		if (t->last_used < lru->last_used)
+			lru = &tiles[i];
+	}
+	t = lru;
+	if (t->cs)
+		cairo_surface_destroy(t->cs);
+	t->cs = cairo_surface_create_similar(cairo_get_target(cr()),
+					     CAIRO_CONTENT_COLOR_ALPHA, w, h);
+	t->w = w;
+	t->h = h;
+	t->radius = radius;
+	t->line_width = line_width;
+	t->fill = fill;
+	memcpy(t->rgba, rgba, sizeof(t->rgba));
+	c = cairo_create(t->cs);
+	rectangle_draw(c, 0, 0, w, h, radius, line_width, fill, rgba);
+	cairo_destroy(c);
+out:
+	t->last_used = ++tile_clock;
+	return t;
+}
+
+void ui_tile_cache_cleanup(void)
+{
+	int i;
+
+	for (i = 0; i < TILE_CACHE_MAX; i++) {
+		if (tiles[i].cs)
+			cairo_surface_destroy(tiles[i].cs);
+		tiles[i].cs = NULL;
+	}
+}
+
+void ui_draw_rectangle(double x, double y, double w, double h, double radius, double line_width, int fill, double *rgba)
+{
+	struct tile *t;
+
+	/*
+	 * Tiles are only used where they give the same result as the path,
+	 * which is when the rectangle sits on whole pixels
+	 */
+	if (radius <= 0 || x != (int)x || y != (int)y || w != (int)w ||
+	    h != (int)h || w <= 0 || h <= 0 || w * h > TILE_AREA_MAX) {
+		rectangle_draw(cr(), x, y, w, h, radius, line_width, fill, rgba);
+		return;
+	}
+	t = tile_get(w, h, radius, line_width, fill, rgba);
+	cairo_set_source_surface(cr(), t->cs, x, y);
+	cairo_paint(cr());
+}
+
 void ui_draw_line(double x0, double y0, double x1, double y1, double line_width, double *rgba)
 {
-	cairo_set_source_rgba(ui->w[ui->cur].c, rgba[0], rgba[1], rgba[2], rgba[3]);
-	cairo_set_line_width(ui->w[ui->cur].c, line_width);
-	cairo_move_to(ui->w[ui->cur].c, x0, y0);
-	cairo_line_to(ui->w[ui->cur].c, x1, y1);
-	cairo_stroke(ui->w[ui->cur].c);
+	cairo_set_source_rgba(cr(), rgba[0], rgba[1], rgba[2], rgba[3]);
+	cairo_set_line_width(cr(), line_width);
+	cairo_move_to(cr(), x0, y0);
+	cairo_line_to(cr(), x1, y1);
+	cairo_stroke(cr());
 }
 
-void ui_insert_text(char *s, int x, int y, int h, int w, double *rgba,
-		    enum alignment align)
+/* Set up the current window's layout for @s. Returns its height in pixels */
+static int layout_text(char *s, int w, enum alignment align)
 {
 	PangoTabArray *tabs;
 	int height;
 
-	pango_layout_set_width(ui->w[ui->cur].pangolayout, w * PANGO_SCALE);
+	pango_layout_set_width(layout(), w * PANGO_SCALE);
 	switch (align) {
 	case RIGHT:
-		pango_layout_set_alignment(ui->w[ui->cur].pangolayout, PANGO_ALIGN_RIGHT);
+		pango_layout_set_alignment(layout(), PANGO_ALIGN_RIGHT);
 		break;
 	case CENTER:
-		pango_layout_set_alignment(ui->w[ui->cur].pangolayout, PANGO_ALIGN_CENTER);
+		pango_layout_set_alignment(layout(), PANGO_ALIGN_CENTER);
 		break;
 	default:
-		pango_layout_set_alignment(ui->w[ui->cur].pangolayout, PANGO_ALIGN_LEFT);
+		pango_layout_set_alignment(layout(), PANGO_ALIGN_LEFT);
 	}
 	tabs = pango_tab_array_new_with_positions(1, TRUE, PANGO_TAB_LEFT, config.tabs);
-	pango_layout_set_wrap(ui->w[ui->cur].pangolayout, PANGO_WRAP_WORD_CHAR);
-	pango_layout_set_ellipsize(ui->w[ui->cur].pangolayout, PANGO_ELLIPSIZE_END);
-	pango_layout_set_font_description(ui->w[ui->cur].pangolayout, ui->w[ui->cur].pangofont);
-	pango_layout_set_tabs(ui->w[ui->cur].pangolayout, tabs);
-	pango_layout_set_markup(ui->w[ui->cur].pangolayout, s, -1);
-	cairo_set_source_rgba(ui->w[ui->cur].c, rgba[0], rgba[1], rgba[2], rgba[3]);
-	pango_cairo_update_layout(ui->w[ui->cur].c, ui->w[ui->cur].pangolayout);
-	pango_layout_get_pixel_size(ui->w[ui->cur].pangolayout, NULL, &height);
-	/* use (h - height) / 2 to center-align vertically */
-	cairo_move_to(ui->w[ui->cur].c, x, y + (h - height) / 2);
-	pango_cairo_show_layout(ui->w[ui->cur].c, ui->w[ui->cur].pangolayout);
+	pango_layout_set_wrap(layout(), PANGO_WRAP_WORD_CHAR);
+	pango_layout_set_ellipsize(layout(), PANGO_ELLIPSIZE_END);
+	pango_layout_set_font_description(layout(), fontdesc());
+	pango_layout_set_tabs(layout(), tabs);
+	pango_layout_set_markup(layout(), s, -1);
+	pango_cairo_update_layout(cr(), layout());
+	pango_layout_get_pixel_size(layout(), NULL, &height);
 	pango_tab_array_free(tabs);
+	return height;
 }
 
-struct point ui_get_text_size(const char *str, const char *fontdesc)
+void ui_insert_text(char *s, int x, int y, int h, int w, double *rgba,
+		    enum alignment align)
 {
+	int height;
+
+	height = layout_text(s, w, align);
+	cairo_set_source_rgba(cr(), rgba[0], rgba[1], rgba[2], rgba[3]);
+	/* use (h - height) / 2 to center-align vertically */
+	cairo_move_to(cr(), x, y + (h - height) / 2);
+	pango_cairo_show_layout(cr(), layout());
+}
+
+/*
+ * Each text cache holds a server-side pixmap, so we only keep surfaces for
+ * the most recently drawn ones. Open windows reserve enough for everything
+ * they show (see ui_text_cache_reserve()), so that labels which are still
+ * visible are not evicted. TEXT_CACHE_MIN leaves room for recently closed
+ * submenus on top of that.
+ */
+#define TEXT_CACHE_MIN (256)
+
+static LIST_HEAD(text_cache_lru);
+static int nr_text_cache_surfaces;
+
+/* Reserve @nr text caches for the current window whilst it is open */
+void ui_text_cache_reserve(int nr)
+{
+	ui->w[ui->cur].nr_text_caches = nr;
+}
+
+static int text_cache_max(void)
+{
+	int i, max = TEXT_CACHE_MIN;
+
+	for (i = 0; ui->w[i].c; i++)
+		max += ui->w[i].nr_text_caches;
+	return max;
+}
+
+void ui_text_cache_free(struct text_cache *cache)
+{
+	if (cache->surface) {
+		cairo_surface_destroy(cache->surface);
+		list_del(&cache->lru);
+		nr_text_cache_surfaces--;
+	}
+	cache->surface = NULL;
+	xfree(cache->text);
+	cache->text = NULL;
+}
+
+static int text_cache_is_valid(struct text_cache *cache, char *s, int h,
+			       int w, double *rgba, enum alignment align)
+{
+	return cache->text && cache->w == w && cache->h == h &&
+	       cache->align == align &&
+	       !memcmp(cache->rgba, rgba, sizeof(cache->rgba)) &&
+	       cache->font_hash == pango_font_description_hash(fontdesc()) &&
+	       !strcmp(cache->text, s);
+}
+
+static void text_cache_render(struct text_cache *cache, char *s, int h, int w,
+			      double *rgba, enum alignment align)
+{
+	PangoRectangle ink, logical;
+	int height, x0, y0, x1, y1;
+	cairo_t *c;
+
+	ui_text_cache_free(cache);
+	cache->text = xstrdup(s);
+	cache->w = w;
+	cache->h = h;
+	cache->align = align;
+	cache->font_hash = pango_font_description_hash(fontdesc());
+	memcpy(cache->rgba, rgba, sizeof(cache->rgba));
+
+	height = layout_text(s, w, align);
+	pango_layout_get_pixel_extents(layout(), &ink, &logical);
+	x0 = MIN(ink.x, logical.x);
+	y0 = MIN(ink.y, logical.y);
+	x1 = MAX(ink.x + ink.width, logical.x + logical.width);
+	y1 = MAX(ink.y + ink.height, logical.y + logical.height);
+	if (x1 <= x0 || y1 <= y0)
+		return;
+	cache->x = x0;
+	cache->y = (h - height) / 2 + y0;
+	cache->surface_w = x1 - x0;
+	cache->surface_h = y1 - y0;
+
+	/*
+	 * Colour is kept, as markup may set it. The surface is similar to the
+	 * canvas, so that painting it is a server-side composite.
+	 */
+	cache->surface = cairo_surface_create_similar(ui->w[ui->cur].cs,
+						      CAIRO_CONTENT_COLOR_ALPHA,
+						      cache->surface_w, cache->surface_h);
+	c = cairo_create(cache->surface);
+	cairo_set_source_rgba(c, rgba[0], rgba[1], rgba[2], rgba[3]);
+	cairo_move_to(c, -x0, -y0);
+	pango_cairo_update_layout(c, layout());
+	pango_cairo_show_layout(c, layout());
+	cairo_destroy(c);
+
+	list_add(&cache->lru, &text_cache_lru);
+	if (++nr_text_cache_surfaces > text_cache_max())
+		ui_text_cache_free(list_last_entry(&text_cache_lru, struct text_cache, lru));
+}
+
+/*
+ * Same as ui_insert_text(), but the layout is only done when @cache does not
+ * hold the same text at the same size and in the same colour. Thereafter it
+ * is just a composite. As colour is part of the key, callers keep a cache for
+ * each colour a piece of text is drawn in, so that a change of selection does
+ * not lay it out again. If @cache is NULL, this is just ui_insert_text().
+ */
+void ui_insert_text_cached(struct text_cache *cache, char *s, int x, int y,
+			   int h, int w, double *rgba, enum alignment align)
+{
+	if (!cache || !ui->w[ui->cur].text_cache_usable) {
+		ui_insert_text(s, x, y, h, w, rgba, align);
+		return;
+	}
+	if (!text_cache_is_valid(cache, s, h, w, rgba, align))
+		text_cache_render(cache, s, h, w, rgba, align);
+	if (!cache->surface)
+		return;
+	list_move(&cache->lru, &text_cache_lru);
+	cairo_set_source_surface(cr(), cache->surface, x + cache->x, y + cache->y);
+	cairo_rectangle(cr(), x + cache->x, y + cache->y, cache->surface_w,
+			cache->surface_h);
+	cairo_fill(cr());
+}
+
+/*
+ * Text is measured with a context which persists between calls, so that we
+ * do not create a surface, layout and font description each time.
+ */
+static struct {
 	cairo_surface_t *cs;
 	cairo_t *c;
 	PangoLayout *layout;
 	PangoFontDescription *font;
-	struct point point;
+	char *fontdesc;
+} measure;
 
-	cs = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 120, 120);
-	c = cairo_create(cs);
-	layout = pango_cairo_create_layout(c);
-	font = pango_font_description_from_string(fontdesc);
-	pango_layout_set_font_description(layout, font);
-	pango_layout_set_markup(layout, str, -1);
-	cairo_set_source_rgba(c, 0, 0, 0, 1.0);
-	pango_cairo_update_layout(c, layout);
-	pango_layout_get_pixel_size(layout, &point.x, &point.y);
-	cairo_surface_destroy(cs);
-	cairo_destroy(c);
-	pango_font_description_free(font);
-	g_object_unref(layout);
+static void measure_cleanup(void)
+{
+	if (!measure.cs)
+		return;
+	pango_font_description_free(measure.font);
+	g_object_unref(measure.layout);
+	cairo_destroy(measure.c);
+	cairo_surface_destroy(measure.cs);
+	xfree(measure.fontdesc);
+	memset(&measure, 0, sizeof(measure));
+}
+
+struct point ui_get_text_size(const char *str, const char *fontdesc)
+{
+	struct point point;
 
+	if (!measure.cs) {
+		measure.cs = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+		measure.c = cairo_create(measure.cs);
+		measure.layout = pango_cairo_create_layout(measure.c);
+	}
+	if (!measure.fontdesc || strcmp(measure.fontdesc, fontdesc)) {
+		if (measure.font)
+			pango_font_description_free(measure.font);
+		xfree(measure.fontdesc);
+		measure.fontdesc = xstrdup(fontdesc);
+		measure.font = pango_font_description_from_string(fontdesc);
+		pango_layout_set_font_description(measure.layout, measure.font);
+	}
+	pango_layout_set_markup(measure.layout, str, -1);
+	pango_layout_get_pixel_size(measure.layout, &point.x, &point.y);
 	return point;
 }
 
@@ -509,48 +1233,144 @@ int ui_is_point_in_area(struct point p, struct area a)
 		return 0;
 }
 
+/*
+ * Areas of the canvas which have been redrawn since the last ui_present().
+ * If more than DAMAGE_MAX areas are added, the last slot grows to cover the
+ * overflow.
+ */
+#define DAMAGE_MAX (8)
+static XRectangle damage[DAMAGE_MAX];
+static int nr_damage;
+
+/* Copy an area of the canvas to the same position in the window */
+static void present_area(int x, int y, int w, int h)
+{
+	struct window_data *wd = &ui->w[ui->cur];
+
+	if (offscreen)
+		return;
+	if (!wd->shmimage) {
+		XCopyArea(ui->dpy, wd->canvas, wd->win, wd->gc, x, y, w, h, x, y);
+		return;
+	}
+	/* unlike XCopyArea(), XShmPutImage() requires the area to be valid */
+	w = MIN(w, wd->canvas_w - x);
+	h = MIN(h, wd->canvas_h - y);
+	if (w <= 0 || h <= 0)
+		return;
+	XShmPutImage(ui->dpy, wd->win, wd->gc, wd->shmimage, x, y, x, y, w, h, False);
+	shm_busy = 1;
+}
+
 void ui_map_window(unsigned int w, unsigned int h)
 {
-	XCopyArea(ui->dpy, ui->w[ui->cur].canvas, ui->w[ui->cur].win, ui->w[ui->cur].gc, 0, 0, w, h, 0, 0);
+	nr_damage = 0;
+	cairo_surface_flush(ui->w[ui->cur].cs);
+	present_area(0, 0, w, h);
+}
+
+/* Restrict drawing to an area until ui_clip_pop() is called */
+void ui_clip_push(int x, int y, int w, int h)
+{
+	cairo_save(cr());
+	cairo_rectangle(cr(), x, y, w, h);
+	cairo_clip(cr());
+}
+
+void ui_clip_pop(void)
+{
+	cairo_restore(cr());
+}
+
+void ui_damage_add(int x, int y, int w, int h)
+{
+	XRectangle *r;
+	int x1, y1;
+
+	if (w <= 0 || h <= 0)
+		return;
+	if (nr_damage < DAMAGE_MAX) {
+		r = &damage[nr_damage++];
+		r->x = x;
+		r->y = y;
+		r->width = w;
+		r->height = h;
+		return;
+	}
+	r = &damage[DAMAGE_MAX - 1];
+	x1 = MAX(r->x + r->width, x + w);
+	y1 = MAX(r->y + r->height, y + h);
+	r->x = MIN(r->x, x);
+	r->y = MIN(r->y, y);
+	r->width = x1 - r->x;
+	r->height = y1 - r->y;
+}
+
+/* Copy the damaged areas of the canvas to the window */
+void ui_present(void)
+{
+	int i;
+
+	cairo_surface_flush(ui->w[ui->cur].cs);
+	for (i = 0; i < nr_damage; i++)
+		present_area(damage[i].x, damage[i].y, damage[i].width,
+			     damage[i].height);
+	nr_damage = 0;
 }
 
 void ui_cleanup(void)
 {
-	XDestroyWindow(ui->dpy, ui->w[ui->cur].win);
-	XUngrabKeyboard(ui->dpy, CurrentTime);
-	XUngrabPointer(ui->dpy, CurrentTime);
-	XDestroyIC(ui->w[0].xic);
-	XCloseIM(ui->xim);
+	if (!offscreen) {
+		XDestroyWindow(ui->dpy, ui->w[ui->cur].win);
+		XUngrabKeyboard(ui->dpy, CurrentTime);
+		XUngrabPointer(ui->dpy, CurrentTime);
+		XDestroyIC(ui->w[0].xic);
+		XCloseIM(ui->xim);
+	}
 
-	if (ui->w[ui->cur].canvas)
-		XFreePixmap(ui->dpy, ui->w[ui->cur].canvas);
 	if (ui->w[ui->cur].gc)
 		XFreeGC(ui->dpy, ui->w[ui->cur].gc);
+	cairo_destroy(ui->w[ui->cur].c);
+	win_canvas_put(ui->cur);
+	ui_tile_cache_cleanup();
+	canvas_pool_cleanup();
+	win_pool_cleanup();
 	if (ui->dpy)
 		XCloseDisplay(ui->dpy);
 
-	cairo_destroy(ui->w[ui->cur].c);
-	cairo_surface_destroy(ui->w[ui->cur].cs);
 	pango_font_description_free(ui->w[ui->cur].pangofont);
 	g_object_unref(ui->w[ui->cur].pangolayout);
+	measure_cleanup();
 	xfree(ui);
 }
 
+/* Icons may be image surfaces or have been uploaded to the X server */
+void ui_image_get_size(cairo_surface_t *image, int *w, int *h)
+{
+	if (cairo_surface_get_type(image) == CAIRO_SURFACE_TYPE_XLIB) {
+		*w = cairo_xlib_surface_get_width(image);
+		*h = cairo_xlib_surface_get_height(image);
+	} else {
+		*w = cairo_image_surface_get_width(image);
+		*h = cairo_image_surface_get_height(image);
+	}
+}
+
 void ui_insert_image(cairo_surface_t *image, double x, double y, double size)
 {
-	double w, h, max;
+	double max;
+	int w, h;
 
-	cairo_save(ui->w[ui->cur].c);
-	cairo_translate(ui->w[ui->cur].c, x, y);
+	cairo_save(cr());
+	cairo_translate(cr(), x, y);
 
 	/* scale */
-	w = cairo_image_surface_get_width(image);
-	h = cairo_image_surface_get_height(image);
+	ui_image_get_size(image, &w, &h);
 	max = h > w ? h : w;
 	if (max != size)
-		cairo_scale(ui->w[ui->cur].c, size / max, size / max);
+		cairo_scale(cr(), size / max, size / max);
 
-	cairo_set_source_surface(ui->w[ui->cur].c, image, 0, 0);
-	cairo_paint(ui->w[ui->cur].c);
-	cairo_restore(ui->w[ui->cur].c);
+	cairo_set_source_surface(cr(), image, 0, 0);
+	cairo_paint(cr());
+	cairo_restore(cr());
 }
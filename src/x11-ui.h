@@ -4,12 +4,14 @@
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
 #include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
 #include <cairo.h>
 #include <cairo-xlib.h>
 #include <pango/pangocairo.h>
 #include <librsvg/rsvg.h>
 
 #include "align.h"
+#include "list.h"
 
 struct area {
 	int x, y, w, h;
@@ -21,14 +23,20 @@ struct point {
 
 struct window_data {
 	Window win;
+	int x, y;			/* position on the root window */
 	XIC xic;
 	XSetWindowAttributes swa;
 	GC gc;
 	Pixmap canvas;
 	cairo_surface_t *cs;
+	int canvas_w, canvas_h;
+	XImage *shmimage;		/* set if canvas is in shared memory */
+	XShmSegmentInfo shminfo;
 	cairo_t *c;
 	PangoLayout *pangolayout;
 	PangoFontDescription *pangofont;
+	int text_cache_usable;		/* see text_cache_check_usable() */
+	int nr_text_caches;		/* reserved by ui_text_cache_reserve() */
 };
 
 struct UI {
@@ -39,37 +47,76 @@ struct UI {
 	int screen;
 	Window root;
 	XVisualInfo vinfo;
+	Colormap colormap;		/* shared by all windows */
+	Cursor cursor;
 	int font_height_actual;		/* used to centre text vertically */
 };
 
 extern struct UI *ui;
 
+/*
+ * A piece of text rendered into a surface of its own, so that it can be
+ * painted again without being laid out. The fields below 'lru' are the key
+ * against which the cache is validated. Zero-initialise before first use.
+ */
+struct text_cache {
+	cairo_surface_t *surface;
+	int x, y;			/* offset of surface from text origin */
+	int surface_w, surface_h;
+	struct list_head lru;		/* only linked whilst 'surface' is set */
+	char *text;
+	int w, h;
+	enum alignment align;
+	unsigned int font_hash;
+	double rgba[4];
+};
+
 int ui_get_workarea(struct area *a);
+void ui_draw_target_set(cairo_t *c, PangoLayout *layout, PangoFontDescription *font);
 void ui_clear_canvas(void);
+void ui_canvas_paint(cairo_surface_t *image);
+void ui_canvas_scroll(int y, int h, int dy);
+int ui_canvas_write_png(const char *filename, int w, int h);
 void grabkeyboard(void);
 void grabpointer(void);
 void ui_init(void);
+void ui_init_offscreen(int screen_width, int screen_height);
+int ui_is_offscreen(void);
 void ui_get_screen_res(int *x0, int *y0, int *width, int *height, int monitor);
 void ui_create_window(int x, int y, int w, int h);
-void ui_init_canvas(int max_width, int max_height);
-void ui_init_cairo(int canvas_width, int canvas_height, const char *font);
-void ui_win_init(int x, int y, int w, int h, int max_w, int max_h, const char *font);
-void ui_win_add(int x, int y, int w, int h, int max_w, int max_h, const char *font);
+void ui_win_move_resize(int x, int y, int w, int h);
+void ui_init_canvas(int width, int height);
+void ui_canvas_ensure(int width, int height);
+void ui_init_cairo(const char *font);
+void ui_win_init(int x, int y, int w, int h, const char *font);
+void ui_win_add(int x, int y, int w, int h, const char *font);
 void ui_win_activate(Window w);
 int ui_has_child_window_open(Window w);
 void ui_win_del(void);
 void ui_win_del_beyond(int w);
+int ui_win_is_open(Window w);
+void ui_win_pool_fill(int nr);
 void ui_draw_rectangle_rounded_at_top(double x, double y, double w, double h, double radius,
 				      double line_width, int fill, double *rgba);
 void ui_draw_rectangle(double x, double y, double w, double h, double radius, double line_width,
 		       int fill, double *rgba);
+void ui_tile_cache_cleanup(void);
 void ui_draw_line(double x0, double y0, double x1, double y1, double line_width, double *rgba);
 void ui_insert_text(char *s, int x, int y, int h, int w, double *rgba,
 		    enum alignment align);
+void ui_insert_text_cached(struct text_cache *cache, char *s, int x, int y,
+			   int h, int w, double *rgba, enum alignment align);
+void ui_text_cache_free(struct text_cache *cache);
+void ui_text_cache_reserve(int nr);
 struct point ui_get_text_size(const char *str, const char *fontdesc);
 int ui_is_point_in_area(struct point p, struct area a);
 void ui_map_window(unsigned int w, unsigned int h);
+void ui_clip_push(int x, int y, int w, int h);
+void ui_clip_pop(void);
+void ui_damage_add(int x, int y, int w, int h);
+void ui_present(void);
 void ui_cleanup(void);
+void ui_image_get_size(cairo_surface_t *image, int *w, int *h);
 void ui_insert_image(cairo_surface_t *image, double x, double y, double size);
 
 #endif /* X11_UI_H */
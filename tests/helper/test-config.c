@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "util.h"
+
+static const char * const csv_env_vars[] = {
+	"JGMENU_VERBOSITY",
+	"JGMENU_NAME_FORMAT",
+	"JGMENU_SINGLE_WINDOW",
+	"JGMENU_NO_DIRS",
+	"JGMENU_I18N",
+	NULL
+};
+
+static void print_csv(void)
+{
+	const char *value;
+	int i;
+
+	printf("csv_cmd=%s\n", config.csv_cmd);
+	for (i = 0; csv_env_vars[i]; i++) {
+		value = getenv(csv_env_vars[i]);
+		if (value)
+			printf("%s=%s\n", csv_env_vars[i], value);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	char line[1024];
+
+	config_set_defaults();
+	while (fgets(line, sizeof(line), stdin)) {
+		line[strcspn(line, "\n")] = '\0';
+		if (!strncmp(line, "read ", 5))
+			config_read_jgmenurc(line + 5);
+		else if (!strcmp(line, "csv_post_process"))
+			config_csv_post_process();
+		else if (!strcmp(line, "post_process"))
+			config_post_process();
+		else if (!strcmp(line, "print"))
+			print_csv();
+	}
+	config_cleanup();
+	return 0;
+}
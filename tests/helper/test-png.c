@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <cairo.h>
+
+static cairo_surface_t *image;
+
+static void open_png(const char *filename)
+{
+	if (image)
+		cairo_surface_destroy(image);
+	image = cairo_image_surface_create_from_png(filename);
+	if (cairo_surface_status(image) != CAIRO_STATUS_SUCCESS) {
+		fprintf(stderr, "fatal: cannot read '%s'\n", filename);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void size(void)
+{
+	printf("%dx%d\n", cairo_image_surface_get_width(image),
+	       cairo_image_surface_get_height(image));
+}
+
+/* Print the colour at (x, y) as #rrggbbaa, without premultiplied alpha */
+static void pixel(const char *arg)
+{
+	unsigned char *data;
+	uint32_t argb;
+	int x, y, a, r, g, b;
+
+	if (sscanf(arg, "%d %d", &x, &y) != 2 || x < 0 || y < 0 ||
+	    x >= cairo_image_surface_get_width(image) ||
+	    y >= cairo_image_surface_get_height(image)) {
+		printf("bad pixel '%s'\n", arg);
+		return;
+	}
+	cairo_surface_flush(image);
+	data = cairo_image_surface_get_data(image);
+	argb = *(uint32_t *)(data + y * cairo_image_surface_get_stride(image) +
+			     x * 4);
+	a = argb >> 24;
+	r = (argb >> 16) & 0xff;
+	g = (argb >> 8) & 0xff;
+	b = argb & 0xff;
+	if (a && a != 0xff) {
+		r = (r * 0xff + a / 2) / a;
+		g = (g * 0xff + a / 2) / a;
+		b = (b * 0xff + a / 2) / a;
+	}
+	printf("#%02x%02x%02x%02x\n", r, g, b, a);
+}
+
+int main(int argc, char **argv)
+{
+	char line[1024];
+
+	while (fgets(line, sizeof(line), stdin)) {
+		line[strcspn(line, "\n")] = '\0';
+		if (!strncmp(line, "open ", 5))
+			open_png(line + 5);
+		else if (!image)
+			continue;
+		else if (!strcmp(line, "size"))
+			size();
+		else if (!strncmp(line, "pixel ", 6))
+			pixel(line + 6);
+	}
+	if (image)
+		cairo_surface_destroy(image);
+	return 0;
+}
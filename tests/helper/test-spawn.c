@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spawn.h"
+#include "isprog.h"
+
+static void split(char *cmd)
+{
+	char *argv[SPAWN_ARGS_MAX + 1];
+	int argc, i;
+
+	argc = spawn_split_command(cmd, argv);
+	if (!argc) {
+		printf("shell\n");
+		return;
+	}
+	for (i = 0; i < argc; i++)
+		printf("%s%s", i ? "@" : "", argv[i]);
+	printf("\n");
+}
+
+static void lookup(const char *name)
+{
+	const char *path;
+
+	path = isprog_lookup(name);
+	printf("%s\n", path ? path : "not found");
+}
+
+int main(int argc, char **argv)
+{
+	char line[1024];
+
+	while (fgets(line, sizeof(line), stdin)) {
+		line[strcspn(line, "\n")] = '\0';
+		if (!strncmp(line, "split ", 6))
+			split(line + 6);
+		else if (!strncmp(line, "lookup ", 7))
+			lookup(line + 7);
+	}
+	return 0;
+}
@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "workers.h"
+
+#define MAX_JOBS (100000)
+
+static int results[MAX_JOBS];
+
+static void square(void *arg, int job)
+{
+	results[job] = job * job;
+}
+
+static void run(int nr_jobs)
+{
+	long long sum = 0;
+	int i;
+
+	memset(results, 0, sizeof(results));
+	workers_parallel(square, NULL, nr_jobs);
+	for (i = 0; i < nr_jobs; i++)
+		sum += results[i];
+	printf("%lld\n", sum);
+}
+
+int main(int argc, char **argv)
+{
+	char line[1024];
+	int nr_jobs;
+
+	while (fgets(line, sizeof(line), stdin)) {
+		if (!strncmp(line, "run ", 4)) {
+			nr_jobs = atoi(line + 4);
+			if (nr_jobs > MAX_JOBS)
+				nr_jobs = MAX_JOBS;
+			run(nr_jobs);
+		} else if (!strncmp(line, "cleanup", 7)) {
+			workers_cleanup();
+		}
+	}
+	workers_cleanup();
+	return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * xbench.c - measure the input latency of a running jgmenu
+ *
+ * Usage: xbench keys <n>
+ *        xbench hover <n> <y_submenu_item> <y_other_item>
+ *
+ * Input is injected with XTest. 'keys' presses Down and Up alternately and
+ * times each key press until the menu window is damaged (i.e. repainted).
+ * 'hover' moves the pointer onto an item which opens a submenu and times
+ * this until the submenu window is mapped, and then moves it onto another
+ * item so that the submenu closes again. The y-coordinates are relative to
+ * the root menu window.
+ *
+ * Latencies are printed in milliseconds as a JSON object.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+#include <X11/extensions/Xdamage.h>
+
+#define TIMEOUT_MS (2000)
+
+static Display *dpy;
+static int damage_event;
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int is_jgmenu(Window win)
+{
+	XClassHint hint;
+	XWindowAttributes attr;
+	int ret;
+
+	if (!XGetWindowAttributes(dpy, win, &attr) || attr.map_state != IsViewable)
+		return 0;
+	if (!XGetClassHint(dpy, win, &hint))
+		return 0;
+	ret = !strcmp(hint.res_class, "jgmenu");
+	XFree(hint.res_name);
+	XFree(hint.res_class);
+	return ret;
+}
+
+static Window find_menu(void)
+{
+	Window root, parent, *children, win = None;
+	unsigned int i, n;
+	int tries;
+
+	for (tries = 0; tries < 500 && win == None; tries++) {
+		if (tries)
+			usleep(10000);
+		if (!XQueryTree(dpy, DefaultRootWindow(dpy), &root, &parent, &children, &n))
+			continue;
+		for (i = 0; i < n; i++) {
+			if (is_jgmenu(children[i])) {
+				win = children[i];
+				break;
+			}
+		}
+		XFree(children);
+	}
+	if (win == None) {
+		fprintf(stderr, "fatal: no jgmenu window found\n");
+		exit(1);
+	}
+	return win;
+}
+
+/* Wait for an event of @type (or a damage event if @type is 0) */
+static int wait_for(int type, Window not_this_window)
+{
+	XEvent ev;
+	fd_set fds;
+	struct timeval tv;
+	double deadline = now_ms() + TIMEOUT_MS;
+	double left;
+
+	for (;;) {
+		while (XPending(dpy)) {
+			XNextEvent(dpy, &ev);
+			if (!type && ev.type == damage_event + XDamageNotify)
+				return 0;
+			if (type == MapNotify && ev.type == MapNotify &&
+			    ev.xmap.window != not_this_window)
+				return 0;
+			if (type == UnmapNotify && ev.type == UnmapNotify &&
+			    ev.xunmap.window != not_this_window)
+				return 0;
+		}
+		left = deadline - now_ms();
+		if (left <= 0)
+			return -1;
+		FD_ZERO(&fds);
+		FD_SET(ConnectionNumber(dpy), &fds);
+		tv.tv_sec = (long)left / 1000;
+		tv.tv_usec = ((long)left % 1000) * 1000;
+		select(ConnectionNumber(dpy) + 1, &fds, NULL, NULL, &tv);
+	}
+}
+
+static void print_results(const char *name, double *ms, int n, int misses)
+{
+	double sum = 0, min = 0, max = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		sum += ms[i];
+		if (!i || ms[i] < min)
+			min = ms[i];
+		if (!i || ms[i] > max)
+			max = ms[i];
+	}
+	printf("{ \"test\": \"%s\", \"samples\": %d, \"timeouts\": %d, ", name, n, misses);
+	printf("\"min_ms\": %.3f, \"mean_ms\": %.3f, \"max_ms\": %.3f }\n",
+	       min, n ? sum / n : 0, max);
+}
+
+static void bench_keys(Window menu, int iterations)
+{
+	Damage damage;
+	KeyCode down, up, key;
+	double *ms, t0;
+	int i, n = 0, misses = 0, error_base;
+
+	if (!XDamageQueryExtension(dpy, &damage_event, &error_base)) {
+		fprintf(stderr, "fatal: no damage extension\n");
+		exit(1);
+	}
+	damage = XDamageCreate(dpy, menu, XDamageReportNonEmpty);
+	down = XKeysymToKeycode(dpy, XK_Down);
+	up = XKeysymToKeycode(dpy, XK_Up);
+	ms = calloc(iterations, sizeof(double));
+	for (i = 0; i < iterations; i++) {
+		XDamageSubtract(dpy, damage, None, None);
+		XSync(dpy, True);
+		key = i % 2 ? up : down;
+		t0 = now_ms();
+		XTestFakeKeyEvent(dpy, key, True, CurrentTime);
+		XTestFakeKeyEvent(dpy, key, False, CurrentTime);
+		XFlush(dpy);
+		if (wait_for(0, None) < 0)
+			misses++;
+		else
+			ms[n++] = now_ms() - t0;
+	}
+	print_results("keys", ms, n, misses);
+	XDamageDestroy(dpy, damage);
+	free(ms);
+}
+
+static void bench_hover(Window menu, int iterations, int y_sub, int y_other)
+{
+	XWindowAttributes attr;
+	Window child;
+	double *ms, t0;
+	int i, n = 0, misses = 0, x, y;
+
+	XGetWindowAttributes(dpy, menu, &attr);
+	XTranslateCoordinates(dpy, menu, DefaultRootWindow(dpy), 0, 0, &x, &y, &child);
+	x += attr.width / 2;
+	XSelectInput(dpy, DefaultRootWindow(dpy), SubstructureNotifyMask);
+	ms = calloc(iterations, sizeof(double));
+	for (i = 0; i < iterations; i++) {
+		XTestFakeMotionEvent(dpy, -1, x, y + y_other, CurrentTime);
+		XSync(dpy, True);
+		usleep(50000);
+		XSync(dpy, True);
+		t0 = now_ms();
+		XTestFakeMotionEvent(dpy, -1, x, y + y_sub, CurrentTime);
+		XFlush(dpy);
+		if (wait_for(MapNotify, menu) < 0)
+			misses++;
+		else
+			ms[n++] = now_ms() - t0;
+		XTestFakeMotionEvent(dpy, -1, x, y + y_other, CurrentTime);
+		XFlush(dpy);
+		wait_for(UnmapNotify, menu);
+	}
+	print_results("hover", ms, n, misses);
+	free(ms);
+}
+
+int main(int argc, char **argv)
+{
+	Window menu;
+	int n;
+
+	if (argc < 3 || (!strcmp(argv[1], "hover") && argc < 5)) {
+		fprintf(stderr, "usage: xbench keys <n>\n"
+				"       xbench hover <n> <y_submenu_item> <y_other_item>\n");
+		exit(1);
+	}
+	dpy = XOpenDisplay(NULL);
+	if (!dpy) {
+		fprintf(stderr, "fatal: cannot open display\n");
+		exit(1);
+	}
+	n = atoi(argv[2]);
+	menu = find_menu();
+	if (!strcmp(argv[1], "keys"))
+		bench_keys(menu, n);
+	else
+		bench_hover(menu, n, atoi(argv[3]), atoi(argv[4]));
+	XCloseDisplay(dpy);
+	return 0;
+}
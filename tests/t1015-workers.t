@@ -0,0 +1,37 @@
+#!/bin/sh
+
+test_description='test worker thread pool'
+. ./sharness.sh
+
+test_workers() {
+	echo "$1" | ../helper/test-workers > actual &&
+	echo "$2" > expect &&
+	test_cmp expect actual
+}
+
+test_expect_success 'single job' '
+
+test_workers "run 1" "0"
+
+'
+
+test_expect_success 'many jobs' '
+
+test_workers "run 1000
+run 3
+run 0" "332833500
+5
+0"
+
+'
+
+test_expect_success 'restart after cleanup' '
+
+test_workers "run 10
+cleanup
+run 10" "285
+285"
+
+'
+
+test_done
@@ -0,0 +1,57 @@
+#!/bin/sh
+
+test_description='test resolution of csv_cmd before the generator is started'
+. ./sharness.sh
+
+unset JGMENU_VERBOSITY JGMENU_NAME_FORMAT JGMENU_SINGLE_WINDOW JGMENU_NO_DIRS JGMENU_I18N
+
+test_config() {
+	echo "$1" | ../helper/test-config > actual &&
+	echo "$2" > expect &&
+	test_cmp expect actual
+}
+
+test_expect_success 'default csv_cmd' '
+
+test_config "csv_post_process
+print" "csv_cmd=jgmenu_run pmenu"
+
+'
+
+test_expect_success 'csv_cmd keyword and variables from jgmenurc' '
+
+cat >jgmenurc <<-\EOF &&
+	csv_cmd = apps
+	csv_no_dirs = 1
+	csv_name_format = %n (%g)
+	EOF
+test_config "read jgmenurc
+csv_post_process
+print" "csv_cmd=jgmenu_run apps
+JGMENU_NAME_FORMAT=%n (%g)
+JGMENU_NO_DIRS=1"
+
+'
+
+test_expect_success 'csv_cmd resolved again after jgmenurc is re-read' '
+
+test_config "read jgmenurc
+csv_post_process
+read jgmenurc
+post_process
+print" "csv_cmd=jgmenu_run apps
+JGMENU_NAME_FORMAT=%n (%g)
+JGMENU_NO_DIRS=1"
+
+'
+
+test_expect_success 'command which is not a keyword' '
+
+echo "csv_cmd = cat foo.csv" >jgmenurc &&
+test_config "read jgmenurc
+csv_post_process
+print" "csv_cmd=cat foo.csv"
+
+'
+
+test_done
@@ -0,0 +1,70 @@
+#!/bin/sh
+
+test_description='test splitting of simple commands and $PATH lookup'
+. ./sharness.sh
+
+test_spawn() {
+	echo "$1" | ../helper/test-spawn > actual &&
+	echo "$2" > expect &&
+	test_cmp expect actual
+}
+
+test_expect_success 'simple commands' '
+
+test_spawn "split firefox
+split  xterm   -e  top 
+split ./run --opt=a,b file.txt
+split /usr/bin/geany	%F" "firefox
+xterm@-e@top
+./run@--opt=a,b@file.txt
+/usr/bin/geany@%F"
+
+'
+
+test_expect_success 'commands which need the shell' '
+
+test_spawn "split echo foo > bar
+split a && b
+split a; b
+split echo \$HOME
+split ls ~/foo
+split echo \"a b\"
+split echo *.txt
+split FOO=1 cmd
+split 
+split    " "shell
+shell
+shell
+shell
+shell
+shell
+shell
+shell
+shell
+shell"
+
+'
+
+test_expect_success 'lookup in $PATH' '
+
+mkdir -p bin1 bin2 &&
+printf "#!/bin/sh\n" >bin2/prog &&
+chmod +x bin2/prog &&
+printf "#!/bin/sh\n" >bin1/not-executable &&
+mkdir bin1/dir &&
+echo "lookup prog
+lookup not-executable
+lookup dir
+lookup nonexistent" |
+PATH="$PWD/bin1:bin2:$PWD/bin2" ../helper/test-spawn >actual &&
+cat >expect <<-EOF &&
+	$PWD/bin2/prog
+	not found
+	not found
+	not found
+	EOF
+test_cmp expect actual
+
+'
+
+test_done
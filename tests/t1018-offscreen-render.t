@@ -0,0 +1,153 @@
+#!/bin/sh
+
+test_description='test offscreen rendering'
+. ./sharness.sh
+
+if ! test -x ../../jgmenu
+then
+	skip_all='jgmenu has not been built'
+	test_done
+fi
+
+unset JGMENU_VERBOSITY JGMENU_NAME_FORMAT JGMENU_SINGLE_WINDOW JGMENU_NO_DIRS JGMENU_I18N
+
+# Opaque colours and no margins, rounded corners or borders, so that pixels
+# away from the text can be checked exactly. Item n spans y = 4 + 20n to
+# 4 + 20(n + 1).
+cat >jgmenurc <<-\EOF
+	menu_width = 100
+	menu_padding_top = 4
+	menu_padding_right = 4
+	menu_padding_bottom = 4
+	menu_padding_left = 4
+	menu_radius = 0
+	menu_border = 0
+	item_margin_x = 0
+	item_margin_y = 0
+	item_height = 20
+	item_radius = 0
+	item_border = 0
+	color_menu_bg = #102030 100
+	color_norm_bg = #000000 0
+	color_sel_bg = #c08040 100
+	EOF
+
+cat >menu.csv <<-\EOF
+	a,true
+	b,true
+	submenu,^checkout(sub)
+	^tag(sub)
+	c,true
+	d,true
+	EOF
+
+offscreen() {
+	../../jgmenu --simple --config-file=jgmenurc --icon-size=0 \
+		--csv-file="${1:-menu.csv}" --offscreen=commands
+}
+
+pixels() {
+	../helper/test-png > actual &&
+	test_cmp expect actual
+}
+
+test_expect_success 'PNGs are written' '
+
+cat >commands <<-\EOF &&
+	png root.png
+	select 0
+	checkout sub
+	png sub.png
+	EOF
+offscreen &&
+test -s root.png &&
+test -s sub.png
+
+'
+
+test_expect_success 'errors in commands are fatal' '
+
+echo "select 9" >commands &&
+test_must_fail offscreen &&
+echo "frobnicate" >commands &&
+test_must_fail offscreen &&
+echo "png no-such-dir/x.png" >commands &&
+test_must_fail offscreen
+
+'
+
+test_expect_success 'background and selected item colours' '
+
+cat >commands <<-\EOF &&
+	select 0
+	png sel0.png
+	select 1
+	png sel1.png
+	EOF
+offscreen &&
+cat >expect <<-\EOF &&
+	#102030ff
+	#c08040ff
+	#102030ff
+	#102030ff
+	#c08040ff
+	EOF
+pixels <<-\EOF
+	open sel0.png
+	pixel 1 1
+	pixel 90 14
+	pixel 90 34
+	open sel1.png
+	pixel 90 14
+	pixel 90 34
+	EOF
+
+'
+
+test_expect_success 'rendering is repeatable' '
+
+cat >commands <<-\EOF &&
+	select 0
+	png a.png
+	select 1
+	render 3
+	select 0
+	png b.png
+	select 1
+	png c.png
+	EOF
+offscreen &&
+test_cmp a.png b.png &&
+! cmp -s a.png c.png
+
+'
+
+test_expect_success 'render a menu with many items' '
+
+echo "submenu,^checkout(sub)" >many.csv &&
+for i in $(seq 500)
+do
+	echo "foo ${i},bar${i},jabber" >>many.csv || return 1
+done &&
+echo "^tag(sub)" >>many.csv &&
+for i in $(seq 20)
+do
+	echo "sub ${i},bar${i},jabber" >>many.csv || return 1
+done &&
+cat >commands <<-\EOF &&
+	render 10
+	png root.png
+	select 0
+	checkout sub
+	select 3
+	render 10
+	png sub.png
+	EOF
+offscreen many.csv >out &&
+test $(grep -c "^render: 10 frames" out) = 2 &&
+test -s root.png &&
+test -s sub.png
+
+'
+
+test_done
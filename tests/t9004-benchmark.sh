@@ -0,0 +1,105 @@
+#!/bin/sh
+
+#
+# Benchmark input latency, frame times and memory use for a range of menu
+# sizes and themes. jgmenu is run under Xvfb and driven with XTest (see
+# helper/xbench.c). Results are printed to stdout as JSON.
+#
+# Environment variables:
+#   BENCH_SIZES       number of items (default "1000 10000 100000")
+#   BENCH_ITERATIONS  samples per measurement (default 50)
+#   BENCH_DISPLAY     display number for Xvfb (default 99)
+#
+
+sizes="${BENCH_SIZES:-1000 10000 100000}"
+iterations="${BENCH_ITERATIONS:-50}"
+display=":${BENCH_DISPLAY:-99}"
+themes="plain rounded"
+
+if ! command -v Xvfb >/dev/null 2>&1
+then
+	printf "%b\n" "$0: skipped (Xvfb not found)" >&2
+	exit 0
+fi
+make -s -C helper xbench >/dev/null || exit 1
+
+tmp_dir=$(mktemp -d)
+Xvfb "${display}" -screen 0 1920x1080x24 -nolisten tcp >/dev/null 2>&1 &
+xvfb_pid=$!
+trap 'kill ${xvfb_pid}; rm -rf "${tmp_dir}"' EXIT
+export DISPLAY="${display}"
+sleep 1
+
+#
+# Both themes put the first item (which opens a submenu) at y=17 and the
+# second at y=42, which is where 'xbench hover' points.
+#
+cat >"${tmp_dir}/plain" <<EOF
+stay_alive = 0
+tint2_look = 0
+position_mode = fixed
+menu_halign = left
+menu_valign = top
+menu_margin_x = 0
+menu_margin_y = 0
+menu_padding_top = 5
+item_height = 25
+item_margin_y = 0
+hover_delay = 0
+icon_size = 0
+EOF
+cat "${tmp_dir}/plain" - >"${tmp_dir}/rounded" <<EOF
+menu_radius = 8
+menu_border = 2
+item_radius = 6
+item_border = 1
+EOF
+
+make_csv () {
+	printf "%b\n" "submenu,^checkout(sub)"
+	for i in $(seq "$1")
+	do
+		printf "%b\n" "foo ${i},bar${i},jabber"
+	done
+	printf "%b\n" "^tag(sub)"
+	for i in $(seq 10)
+	do
+		printf "%b\n" "sub ${i},bar${i}"
+	done
+}
+
+# Print the average draw_menu() time in ms
+frame_time () {
+	printf "%b\n" "render ${iterations}" >"${tmp_dir}/commands"
+	../jgmenu --config-file="${tmp_dir}/$1" --csv-file="${tmp_dir}/menu.csv" \
+		--offscreen="${tmp_dir}/commands" 2>/dev/null |
+		sed -n 's/.*(\(.*\)ms per frame)/\1/p'
+}
+
+printf "%b\n" "["
+sep=""
+for size in ${sizes}
+do
+	make_csv "${size}" >"${tmp_dir}/menu.csv"
+	for theme in ${themes}
+	do
+		frame_ms=$(frame_time "${theme}")
+
+		../jgmenu --config-file="${tmp_dir}/${theme}" \
+			--csv-file="${tmp_dir}/menu.csv" 2>/dev/null &
+		pid=$!
+		keys=$(helper/xbench keys "${iterations}")
+		hover=$(helper/xbench hover "${iterations}" 17 42)
+		hwm=$(sed -n 's/^VmHWM:[ \t]*\([0-9]*\) kB/\1/p' /proc/${pid}/status)
+		kill ${pid}
+		wait ${pid} 2>/dev/null
+
+		printf "%b" "${sep}"
+		printf "  { \"items\": %d, \"theme\": \"%s\", " "${size}" "${theme}"
+		printf "\"frame_ms\": %s, \"vmhwm_kb\": %s,\n" "${frame_ms:-null}" "${hwm:-null}"
+		printf "    \"keys\": %s,\n" "${keys:-null}"
+		printf "    \"hover\": %s }" "${hover:-null}"
+		sep=",\n"
+	done
+done
+printf "%b\n" "\n]"